@@ -58,4 +58,12 @@ TEST(collatz, runtime) {
     show(CTSTR("<1111111>")); // 7 - 22 - 11 - 34 - 17 - 52 - 13 - 40 - 20 - 10 - 5 - 16 - 8 - 4 - 2 - 1
 }
 
+TEST(collatz, rle) {
+    // unary numbers are long runs of ones, so run-length encoding keeps the text tiny
+    for (size_t n : {1, 2, 3, 7, 27, 1000}) {
+        std::string src = "<" + std::string(n, '1') + ">";
+        EXPECT_EQ(machine(::nn::rle_text{src}).str(), machine(src)) << n;
+    }
+}
+
 } // namespace examples::collatz_unary
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <utility>
+
+namespace nn {
+
+// lazy sequence produced by a coroutine (a minimal std::generator, which the standard library may lack).
+// the coroutine frame is allocated once; yielded values are not copied:
+// the iterator refers to the value alive in the suspended coroutine.
+// it's an input view: iterate once, the coroutine resumes on each increment.
+
+template<class T> class generator : public std::ranges::view_interface<generator<T>> {
+public:
+    struct promise_type {
+        T const* current = nullptr;
+
+        generator get_return_object() { return generator{handle::from_promise(*this)}; }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_always final_suspend() const noexcept { return {}; }
+        std::suspend_always yield_value(T const& v) noexcept {
+            current = std::addressof(v);
+            return {};
+        }
+        void return_void() const noexcept {}
+        void unhandled_exception() const { throw; } // to the one who resumed
+        template<class U> void await_transform(U&&) = delete; // no co_await
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(handle h) : h_{h} {}
+
+        T const& operator*() const { return *h_.promise().current; }
+        T const* operator->() const { return h_.promise().current; }
+        iterator& operator++() {
+            h_.resume();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator == (std::default_sentinel_t) const { return !h_ || h_.done(); }
+
+    private:
+        handle h_;
+    };
+
+    generator() = default;
+    generator(generator&& other) noexcept : h_{std::exchange(other.h_, {})} {}
+    generator& operator = (generator other) noexcept {
+        std::swap(h_, other.h_);
+        return *this;
+    }
+    ~generator() {
+        if (h_)
+            h_.destroy();
+    }
+
+    iterator begin() {
+        if (h_)
+            h_.resume();
+        return iterator{h_};
+    }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    explicit generator(handle h) : h_{h} {}
+
+    handle h_;
+};
+
+} // namespace nn
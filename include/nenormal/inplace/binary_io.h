@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace nn {
+
+// helpers for binary files of the runtime: traces and checkpoints.
+// - varints (7 bits per byte, little end first) and length-prefixed bytes,
+// - a cursor that reads them back and throws on truncated data,
+// - a single edit between two texts.
+
+namespace binary_io_ns {
+
+inline void put_varint(std::string& out, size_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline void put_bytes(std::string& out, std::string_view s) {
+    put_varint(out, s.size());
+    out.append(s);
+}
+
+struct cursor {
+    std::string_view data;
+    size_t pos = 0;
+
+    bool done() const { return pos == data.size(); }
+    char get() {
+        if (pos >= data.size())
+            throw std::runtime_error("truncated data");
+        return data[pos++];
+    }
+    size_t varint() {
+        size_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            unsigned char c = static_cast<unsigned char>(get());
+            v |= size_t(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return v;
+        }
+    }
+    std::string_view bytes() {
+        size_t n = varint();
+        if (n > data.size() - pos)
+            throw std::runtime_error("truncated data");
+        std::string_view s = data.substr(pos, n);
+        pos += n;
+        return s;
+    }
+};
+
+} // namespace binary_io_ns
+
+// the edit which turns a into b: the range [pos, pos+erased) of a is replaced with inserted.
+// it is the minimal range outside the common prefix and suffix.
+struct text_edit {
+    size_t pos = 0;
+    size_t erased = 0;
+    std::string_view inserted;
+
+    static text_edit between(std::string_view a, std::string_view b) {
+        size_t prefix = std::mismatch(a.begin(), a.end(), b.begin(), b.end()).first - a.begin();
+        size_t common = std::min(a.size(), b.size()) - prefix;
+        size_t suffix = std::mismatch(a.rbegin(), a.rbegin() + common, b.rbegin()).first - a.rbegin();
+        return {prefix, a.size() - prefix - suffix, b.substr(prefix, b.size() - prefix - suffix)};
+    }
+    void apply(std::string& a) const { a.replace(pos, erased, inserted); }
+};
+
+} // namespace nn
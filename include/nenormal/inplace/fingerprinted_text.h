@@ -0,0 +1,248 @@
+#pragma once
+
+#include "../concepts.h"
+#include "../ct.h"
+#include "../str.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn {
+
+// fingerprinted text is an inplace text which maintains a hash of itself.
+// the hash is polynomial: H(t) = sum t[i] * B^(n-1-i) mod (2^61 - 1),
+// so H(xy) = H(x) * B^|y| + H(y).
+//
+// the text is covered by chunks of 32..64 chars (but the last ones), kept in an implicit treap
+// where every node knows the hash and length of its subtree.
+// a substitution re-chunks only the chunks it touches,
+// so the update costs O(|s| + |r| + log n) besides the substitution itself.
+//
+// for two different texts of length up to n, the probability of the same hash
+// over the choice of B is at most n / 2^61 (the difference is a polynomial of degree < n).
+// B is fixed, so the hash is reproducible between runs, but it's not safe against adversarial texts.
+
+CONCEPT(FingerprintedText)
+
+namespace fingerprint_hash_ns {
+
+constexpr uint64_t mod = (uint64_t{1} << 61) - 1;
+constexpr uint64_t base = 0x1f3d5b79a2c4e6f1ull % mod;
+
+constexpr uint64_t mul(uint64_t a, uint64_t b) {
+    unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+    uint64_t r = static_cast<uint64_t>(p & mod) + static_cast<uint64_t>(p >> 61);
+    return r >= mod ? r - mod : r;
+}
+constexpr uint64_t add(uint64_t a, uint64_t b) {
+    uint64_t r = a + b;
+    return r >= mod ? r - mod : r;
+}
+
+// hash and B^length of a string
+struct span_hash {
+    uint64_t hash = 0;
+    uint64_t power = 1;
+    size_t length = 0;
+
+    constexpr span_hash operator + (span_hash const& r) const {
+        return {add(mul(hash, r.power), r.hash), mul(power, r.power), length + r.length};
+    }
+    static constexpr span_hash of(std::string_view s) {
+        span_hash h;
+        for (char c : s) {
+            h.hash = add(mul(h.hash, base), static_cast<unsigned char>(c) + 1);
+            h.power = mul(h.power, base);
+        }
+        h.length = s.size();
+        return h;
+    }
+};
+
+} // namespace fingerprint_hash_ns
+
+class fingerprinted_text {
+public:
+    REPRESENTS(FingerprintedText)
+
+    static constexpr size_t min_chunk = 32;
+    static constexpr size_t max_chunk = 64;
+
+    fingerprinted_text() = default;
+    explicit fingerprinted_text(std::string s) : text_{std::move(s)} {
+        root_ = build(0, text_.size());
+    }
+
+    std::string const& str() const { return text_; }
+    size_t size() const { return text_.size(); }
+    size_t chunks() const { return nodes_.size() - free_.size(); }
+
+    // cheap: the hash is maintained by substitutions
+    uint64_t fingerprint() const { return total(root_).hash; }
+    // same hash computed from scratch (for checks and benchmarks)
+    static uint64_t fingerprint_of(std::string_view s) { return fingerprint_hash_ns::span_hash::of(s).hash; }
+
+    // replaces s.size() chars at pos with r, and updates the hash
+    void replace(size_t pos, size_t erased, std::string_view r) {
+        text_.replace(pos, erased, r);
+
+        // A - chunks before the edit, M - chunks touched by the edit, C - after the edit
+        auto [a, rest] = split_end(root_, pos);
+        size_t a_len = total(a).length;
+        auto [m, c] = split_start(rest, std::max(pos + erased - a_len, size_t{1}));
+        size_t region = total(m).length + r.size() - erased;
+        // do not leave small chunks behind
+        if (region < min_chunk && c != npos) {
+            auto [first, tail] = split_start(c, 1);
+            region += total(first).length;
+            c = tail;
+        }
+        free_subtree(m);
+        root_ = merge(merge(a, build(a_len, a_len + region)), c);
+    }
+
+    bool operator == (fingerprinted_text const& other) const { return text_ == other.text_; }
+    bool operator == (std::string_view s) const { return text_ == s; }
+
+    friend std::ostream& operator << (std::ostream& os, fingerprinted_text const& v) {
+        return os << std::quoted(v.text_) << "_fp";
+    }
+
+private:
+    using span_hash = fingerprint_hash_ns::span_hash;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct node {
+        size_t left = npos;
+        size_t right = npos;
+        uint32_t priority = 0;
+        span_hash chunk;   // of the chunk itself
+        span_hash subtree; // of the subtree
+    };
+
+    span_hash total(size_t t) const { return t == npos ? span_hash{} : nodes_[t].subtree; }
+
+    void update(size_t t) {
+        node& n = nodes_[t];
+        n.subtree = total(n.left) + n.chunk + total(n.right);
+    }
+
+    size_t make_node(span_hash chunk) {
+        seed_ = seed_ * 6364136223846793005ull + 1442695040888963407ull;
+        node n{npos, npos, static_cast<uint32_t>(seed_ >> 33), chunk, chunk};
+        if (free_.empty()) {
+            nodes_.push_back(n);
+            return nodes_.size() - 1;
+        }
+        size_t t = free_.back();
+        free_.pop_back();
+        nodes_[t] = n;
+        return t;
+    }
+    void free_subtree(size_t t) {
+        if (t == npos)
+            return;
+        free_subtree(nodes_[t].left);
+        free_subtree(nodes_[t].right);
+        free_.push_back(t);
+    }
+
+    size_t merge(size_t l, size_t r) {
+        if (l == npos)
+            return r;
+        if (r == npos)
+            return l;
+        if (nodes_[l].priority > nodes_[r].priority) {
+            size_t m = merge(nodes_[l].right, r);
+            nodes_[l].right = m;
+            update(l);
+            return l;
+        } else {
+            size_t m = merge(l, nodes_[r].left);
+            nodes_[r].left = m;
+            update(r);
+            return r;
+        }
+    }
+
+    // left: chunks that end at or before k
+    std::pair<size_t, size_t> split_end(size_t t, size_t k) {
+        if (t == npos)
+            return {npos, npos};
+        size_t left_len = total(nodes_[t].left).length;
+        size_t end = left_len + nodes_[t].chunk.length;
+        if (end <= k) {
+            auto [l, r] = split_end(nodes_[t].right, k - end);
+            nodes_[t].right = l;
+            update(t);
+            return {t, r};
+        } else {
+            auto [l, r] = split_end(nodes_[t].left, k);
+            nodes_[t].left = r;
+            update(t);
+            return {l, t};
+        }
+    }
+    // left: chunks that start before k
+    std::pair<size_t, size_t> split_start(size_t t, size_t k) {
+        if (t == npos)
+            return {npos, npos};
+        size_t start = total(nodes_[t].left).length;
+        if (start < k) {
+            size_t end = start + nodes_[t].chunk.length;
+            auto [l, r] = split_start(nodes_[t].right, k > end ? k - end : 0);
+            nodes_[t].right = l;
+            update(t);
+            return {t, r};
+        } else {
+            auto [l, r] = split_start(nodes_[t].left, k);
+            nodes_[t].left = r;
+            update(t);
+            return {l, t};
+        }
+    }
+
+    // treap of chunks covering text_[from, to)
+    size_t build(size_t from, size_t to) {
+        size_t n = to - from;
+        size_t count = (n + max_chunk - 1) / max_chunk; // chunks of equal sizes, within [min, max]
+        size_t t = npos;
+        for (size_t i = 0; i != count; ++i) {
+            size_t b = from + n * i / count;
+            size_t e = from + n * (i + 1) / count;
+            t = merge(t, make_node(span_hash::of(std::string_view{text_}.substr(b, e - b))));
+        }
+        return t;
+    }
+
+    std::string text_;
+    std::vector<node> nodes_;
+    std::vector<size_t> free_;
+    size_t root_ = npos;
+    uint64_t seed_ = 0x853c49e6748fea9bull;
+};
+
+// same as try_substitute_inplace for std::string
+bool try_substitute_inplace(CtStr auto cts, CtStr auto ctr, fingerprinted_text& text) {
+    constexpr Str auto const& s = cts.value;
+    constexpr Str auto const& r = ctr.value;
+
+    if (s.empty() && r.empty())
+        return true;
+    std::string const& t = text.str();
+    auto it = std::search(t.begin(), t.end(), s.begin(), s.end());
+    if (it == t.end() && !s.empty())
+        return false;
+    text.replace(it - t.begin(), s.size(), r.view());
+    return true;
+}
+
+inline fingerprinted_text& inplace_extract_text(fingerprinted_text& t) { return t; }
+void inplace_update_text(fingerprinted_text& t, auto p) {}
+
+} // namespace nn
@@ -1,15 +1,47 @@
 #pragma once
 
 #include "../concepts.h"
+#include <cstring>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
 namespace nn {
 
 CONCEPT(InplaceAugmentation)
 
+// accumulators of plain types can be saved to and loaded from raw bytes (see checkpoints)
+namespace inplace_augmented_helpers_ns {
+
+template<class A> void save_raw(A const& a, std::string& out) {
+    out.append(reinterpret_cast<char const*>(&a), sizeof(A));
+}
+template<class A> void load_raw(A& a, std::string_view in) {
+    if (in.size() != sizeof(A))
+        throw std::runtime_error("unexpected size of accumulator");
+    std::memcpy(&a, in.data(), sizeof(A));
+}
+
+} // namespace inplace_augmented_helpers_ns
+
+// augmentation that accepts a bulk step event: rule p has been applied n times in a row
+CONCEPT(InplaceBulkAugmentation)
+
+// augmentation that accepts edit events: the step replaced `removed` bytes at pos with `inserted`
+// (which is also the text at pos after the step), so it may do O(edit) work per step:
+//   edit(p, pos, removed, inserted, t)
+//   bulk_edit(p, pos, removed, inserted, t, n) - if it's also a bulk augmentation:
+//     n steps in a row, which together replaced [pos, pos + removed)
+// rules which don't know the edit of their step (e.g. bulk loop passes) still call operator() or bulk().
+CONCEPT(InplaceEditAugmentation)
+
 struct inplace_empty {
     REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
     constexpr void operator()(auto p, std::string const& t) const {}
+    constexpr void bulk(auto p, std::string const& t, size_t n) const {}
+    void save(std::string& out) const {}
+    void load(std::string_view in) {}
 
     constexpr bool operator == (inplace_empty const&) const = default;
 };
@@ -17,9 +49,11 @@ struct inplace_empty {
 template<class A>
 struct inplace_passed {
     REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
     A a;
 
     constexpr void operator()(auto p, std::string const& t) const {}
+    constexpr void bulk(auto p, std::string const& t, size_t n) const {}
 
     constexpr bool operator == (inplace_passed const&) const = default;
 
@@ -47,6 +81,10 @@ struct inplace_cumulative_effect {
     A a;
     F f; // A f(A&& a, auto p, std::string const& t)
     constexpr void operator()(auto p, std::string const& t) { a = f(a, p, t); }
+    void save(std::string& out) const requires std::is_trivially_copyable_v<A>
+    { inplace_augmented_helpers_ns::save_raw(a, out); }
+    void load(std::string_view in) requires std::is_trivially_copyable_v<A>
+    { inplace_augmented_helpers_ns::load_raw(a, in); }
 
     constexpr bool operator == (inplace_cumulative_effect const& other) const
         requires requires { a == other.a; }
@@ -59,12 +97,76 @@ struct inplace_modification_effect {
     A a;
     F f; // void f(A& a, auto p, std::string const& t)
     constexpr void operator()(auto p, std::string const& t) { f(a, p, t); }
+    void save(std::string& out) const requires std::is_trivially_copyable_v<A>
+    { inplace_augmented_helpers_ns::save_raw(a, out); }
+    void load(std::string_view in) requires std::is_trivially_copyable_v<A>
+    { inplace_augmented_helpers_ns::load_raw(a, in); }
 
     constexpr bool operator == (inplace_modification_effect const& other) const
         requires requires { a == other.a; }
     { return a == other.a; } // do not compare functions
 };
 
+// cumulative effect which sees a series of n same steps as a single call f(a, p, t, n)
+template<class A, class F>
+struct inplace_bulk_effect {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
+    A a;
+    F f; // A f(A&& a, auto p, std::string const& t, size_t n)
+    constexpr void operator()(auto p, std::string const& t) { a = f(a, p, t, size_t{1}); }
+    constexpr void bulk(auto p, std::string const& t, size_t n) { a = f(a, p, t, n); }
+    void save(std::string& out) const requires std::is_trivially_copyable_v<A>
+    { inplace_augmented_helpers_ns::save_raw(a, out); }
+    void load(std::string_view in) requires std::is_trivially_copyable_v<A>
+    { inplace_augmented_helpers_ns::load_raw(a, in); }
+
+    constexpr bool operator == (inplace_bulk_effect const& other) const
+        requires requires { a == other.a; }
+    { return a == other.a; } // do not compare functions
+};
+
+// side effect on edits: f(p, pos, removed, inserted, t).
+// a step reported without its edit comes as the replacement of the whole text,
+// so size is the size of the text before the next event (initially, of the input text).
+template<class F>
+struct inplace_edit_effect {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceEditAugmentation);
+    F f;
+    size_t size = 0;
+
+    constexpr void operator()(auto p, std::string const& t) { edit(p, 0, size, t, t); }
+    constexpr void edit(auto p, size_t pos, size_t removed, std::string_view inserted, std::string const& t) {
+        f(p, pos, removed, inserted, t);
+        size = t.size();
+    }
+    constexpr bool operator == (inplace_edit_effect const& other) const { return size == other.size; } // do not compare functions
+};
+
+// catches the edit of a step (see facade_rule)
+struct inplace_edit_capture {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceEditAugmentation);
+    size_t pos = 0;
+    size_t removed = 0;
+    size_t inserted = 0;
+    size_t edits = 0;     // steps reported with their edits
+    bool unknown = false; // a step reported without its edit
+
+    constexpr void operator()(auto p, std::string const& t) { unknown = true; }
+    constexpr void edit(auto p, size_t at, size_t r, std::string_view i, std::string const& t) {
+        pos = at;
+        removed = r;
+        inserted = i.size();
+        ++edits;
+    }
+    // the edit is known if it's the only one
+    constexpr bool known() const { return !unknown && edits == 1; }
+
+    constexpr bool operator == (inplace_edit_capture const&) const = default;
+};
+
 CONCEPT(InplaceAugmented);
 
 template<InplaceAugmentation A>
@@ -88,4 +190,42 @@ constexpr std::string& inplace_extract_text(InplaceAugmented auto& t) { return t
 constexpr void inplace_update_text(std::string& t, auto p) {}
 constexpr void inplace_update_text(InplaceAugmented auto& t, auto p) { t.aux(p, t.text); }
 
+template<class T> concept InplaceEditInput =
+    InplaceAugmented<T> && InplaceEditAugmentation<decltype(std::remove_cvref_t<T>::aux)>;
+
+// the step with its edit (any text; only edit augmentations see the edit)
+constexpr void inplace_update_text_edit(auto& t, auto p, size_t pos, size_t removed, std::string_view inserted) {
+    inplace_update_text(t, p);
+}
+constexpr void inplace_update_text_edit(InplaceAugmented auto& t, auto p, size_t pos, size_t removed, std::string_view inserted) {
+    if constexpr (InplaceEditInput<decltype(t)>)
+        t.aux.edit(p, pos, removed, inserted, t.text);
+    else
+        t.aux(p, t.text);
+}
+
+// loops call it before every step (before the matching starts),
+// for augmentations which measure steps: they may have step_begin()
+constexpr void inplace_step_begin(auto& t) {}
+constexpr void inplace_step_begin(InplaceAugmented auto& t) {
+    if constexpr (requires { t.aux.step_begin(); })
+        t.aux.step_begin();
+}
+
+// bulk step is allowed only if the augmentation accepts it
+template<class T> concept InplaceBulkInput =
+    std::same_as<std::remove_cvref_t<T>, std::string> ||
+    (InplaceAugmented<T> && InplaceBulkAugmentation<decltype(std::remove_cvref_t<T>::aux)>);
+
+constexpr void inplace_update_text_bulk(std::string& t, auto p, size_t n) {}
+constexpr void inplace_update_text_bulk(InplaceAugmented auto& t, auto p, size_t n) { t.aux.bulk(p, t.text, n); }
+
+constexpr void inplace_update_text_bulk_edit(std::string& t, auto p, size_t n, size_t pos, size_t removed, std::string_view inserted) {}
+constexpr void inplace_update_text_bulk_edit(InplaceAugmented auto& t, auto p, size_t n, size_t pos, size_t removed, std::string_view inserted) {
+    if constexpr (InplaceEditInput<decltype(t)>)
+        t.aux.bulk_edit(p, pos, removed, inserted, t.text, n);
+    else
+        t.aux.bulk(p, t.text, n);
+}
+
 } // namespace nn
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "inplace_augmented.h"
+#include "mapped_file.h"
+#include "binary_io.h"
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace nn {
+
+// binary trace of an inplace run.
+//
+// the recorder is an inplace augmentation which writes, for every step,
+// an edit record (rule id, position, erased length, inserted bytes),
+// and a full-text keyframe every K steps (and at the step 0).
+// the edit is the difference between the previous and the current text,
+// so it does not depend on what kind of rule (single, facade, ...) reported the step.
+//
+// the reader indexes keyframes and restores the text at any step
+// from the nearest keyframe by at most K-1 edits.
+//
+// format: "NNTR" version:u8 K:varint, then records
+//   'R' id:varint name:bytes        - name of a rule id, before its first use
+//   'K' step:varint text:bytes      - keyframe: text after the step
+//   'E' id:varint pos:varint erased:varint inserted:bytes - next step
+// where bytes = length:varint + raw bytes.
+
+namespace trace_ns {
+
+constexpr std::string_view magic = "NNTR";
+constexpr unsigned char version = 1;
+
+using namespace binary_io_ns;
+
+template<class P> std::string rule_name(P const& p) {
+    if constexpr (requires (std::ostream& os) { os << p; }) {
+        std::ostringstream ss;
+        ss << p;
+        return ss.str();
+    } else {
+        return typeid(P).name();
+    }
+}
+
+} // namespace trace_ns
+
+struct inplace_trace_recorder {
+    REPRESENTS(InplaceAugmentation);
+
+    std::ostream* os = nullptr;
+    size_t keyframe_interval = 1000;
+    std::string text;  // previous text
+    size_t step = 0;
+    std::map<std::type_index, size_t> ids;
+    std::string buffer; // record being written
+
+    inplace_trace_recorder(std::ostream& os, std::string_view initial, size_t keyframe_interval = 1000)
+        : os{&os}, keyframe_interval{std::max<size_t>(keyframe_interval, 1)}, text{initial}
+    {
+        buffer.append(trace_ns::magic);
+        buffer.push_back(static_cast<char>(trace_ns::version));
+        trace_ns::put_varint(buffer, this->keyframe_interval);
+        put_keyframe();
+        flush();
+    }
+
+    void operator()(auto p, std::string const& t) {
+        size_t id = id_of(p);
+
+        // the edit is what differs between the previous and the current texts
+        text_edit e = text_edit::between(text, t);
+
+        buffer.push_back('E');
+        trace_ns::put_varint(buffer, id);
+        trace_ns::put_varint(buffer, e.pos);
+        trace_ns::put_varint(buffer, e.erased);
+        trace_ns::put_bytes(buffer, e.inserted);
+        e.apply(text);
+        ++step;
+
+        if (step % keyframe_interval == 0)
+            put_keyframe();
+        flush();
+    }
+
+    bool operator == (inplace_trace_recorder const& other) const { return step == other.step; }
+
+private:
+    size_t id_of(auto const& p) {
+        auto [it, added] = ids.try_emplace(typeid(p), ids.size());
+        if (added) {
+            buffer.push_back('R');
+            trace_ns::put_varint(buffer, it->second);
+            trace_ns::put_bytes(buffer, trace_ns::rule_name(p));
+        }
+        return it->second;
+    }
+    void put_keyframe() {
+        buffer.push_back('K');
+        trace_ns::put_varint(buffer, step);
+        trace_ns::put_bytes(buffer, text);
+    }
+    void flush() {
+        os->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+};
+
+class trace_reader {
+public:
+    explicit trace_reader(std::string data) : owned_{std::move(data)}, data_{owned_} { index(); }
+    explicit trace_reader(mapped_file f) : mapped_{std::move(f)}, data_{mapped_.view()} { index(); }
+    static trace_reader from_file(std::string const& path) { return trace_reader{mapped_file{path}}; }
+
+    trace_reader(trace_reader const&) = delete; // views into own data
+
+    size_t steps() const { return steps_; }
+    size_t keyframe_interval() const { return keyframe_interval_; }
+    std::string_view rule_name(size_t id) const { return names_.at(id); }
+
+    // rule that made the step (empty for the step 0)
+    std::string_view rule_at(size_t step) const {
+        std::string_view name;
+        for_each(step, step, [&](size_t, std::string_view r, std::string const&) { name = r; });
+        return name;
+    }
+
+    std::string text_at(size_t step) const {
+        std::string text;
+        for_each(step, step, [&](size_t, std::string_view, std::string const& t) { text = t; });
+        return text;
+    }
+
+    // calls f(step, rule name, text after the step) for steps in [from, to]
+    template<class F> void for_each(size_t from, size_t to, F&& f) const {
+        if (from > to || to > steps_)
+            throw std::out_of_range("trace step");
+        auto kf = std::upper_bound(keyframes_.begin(), keyframes_.end(), from,
+            [](size_t s, keyframe const& k) { return s < k.step; }) - 1;
+        trace_ns::cursor c{data_, kf->offset};
+        c.get(); // 'K'
+        size_t step = c.varint();
+        std::string text{c.bytes()};
+        std::string_view rule = kf->rule == npos ? std::string_view{} : names_[kf->rule];
+        while (true) {
+            if (step >= from)
+                f(step, rule, std::as_const(text));
+            if (step == to)
+                return;
+            // next step
+            char tag;
+            while ((tag = c.get()) != 'E') {
+                if (tag == 'R') {
+                    c.varint();
+                    c.bytes();
+                } else if (tag == 'K') {
+                    c.varint();
+                    c.bytes();
+                } else {
+                    throw std::runtime_error("corrupted trace");
+                }
+            }
+            rule = names_.at(c.varint());
+            size_t pos = c.varint();
+            size_t erased = c.varint();
+            text.replace(pos, erased, c.bytes());
+            ++step;
+        }
+    }
+
+private:
+    static constexpr size_t npos = std::string::npos;
+
+    struct keyframe {
+        size_t step;
+        size_t offset; // of the 'K' tag
+        size_t rule;   // that made the step
+    };
+
+    void index() {
+        trace_ns::cursor c{data_};
+        for (char m : trace_ns::magic)
+            if (c.get() != m)
+                throw std::runtime_error("not a nenormal trace");
+        if (static_cast<unsigned char>(c.get()) != trace_ns::version)
+            throw std::runtime_error("unsupported trace version");
+        keyframe_interval_ = c.varint();
+        size_t rule = npos;
+        while (!c.done()) {
+            size_t offset = c.pos;
+            char tag = c.get();
+            if (tag == 'R') {
+                size_t id = c.varint();
+                if (names_.size() <= id)
+                    names_.resize(id + 1);
+                names_[id] = c.bytes();
+            } else if (tag == 'K') {
+                size_t step = c.varint();
+                c.bytes();
+                keyframes_.push_back({step, offset, rule});
+            } else if (tag == 'E') {
+                rule = c.varint();
+                c.varint();
+                c.varint();
+                c.bytes();
+                ++steps_;
+            } else {
+                throw std::runtime_error("corrupted trace");
+            }
+        }
+        if (keyframes_.empty())
+            throw std::runtime_error("truncated trace");
+    }
+
+    std::string owned_;
+    mapped_file mapped_;
+    std::string_view data_;
+    size_t keyframe_interval_ = 0;
+    size_t steps_ = 0;
+    std::vector<std::string_view> names_;
+    std::vector<keyframe> keyframes_;
+};
+
+} // namespace nn
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nn {
+
+// read-only memory mapping of a whole file (posix).
+// the mapping lives as long as the object; it's movable, not copyable.
+
+class mapped_file {
+public:
+    mapped_file() = default;
+    explicit mapped_file(std::string const& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ != 0) {
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), path);
+            }
+            ::madvise(p, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<char const*>(p);
+        }
+        ::close(fd); // the mapping keeps the file
+    }
+    ~mapped_file() {
+        if (data_)
+            ::munmap(const_cast<char*>(data_), size_);
+    }
+    mapped_file(mapped_file&& other) noexcept
+        : data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)} {}
+    mapped_file& operator = (mapped_file&& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    std::string_view view() const { return {data_, size_}; }
+
+private:
+    char const* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace nn
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "../concepts.h"
+#include "../ct.h"
+#include "../str.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace nn {
+
+// piece text is an inplace text for huge inputs, which are never fully materialized.
+// the text is a list of pieces (string views) into
+// - a read-only source: memory-mapped file or a string given at start,
+// - replacement strings of the rules (they are compile-time constants with static storage),
+// - own chunks, where short pieces are compacted from time to time.
+// so, resident memory is bounded by the number of pieces, not by the length of text.
+// the result is streamed piece by piece.
+
+CONCEPT(PieceText)
+
+class piece_text {
+public:
+    REPRESENTS(PieceText)
+
+    static constexpr size_t chunk_size = size_t{1} << 16;   // size of own chunks
+    static constexpr size_t compact_min_pieces = 1024;      // do not compact fewer pieces
+
+    piece_text() = default;
+    explicit piece_text(std::string s) : source_{std::make_shared<source>(std::move(s))} { reset(); }
+    explicit piece_text(mapped_file f) : source_{std::make_shared<source>(std::move(f))} { reset(); }
+
+    static piece_text from_file(std::string const& path) { return piece_text{mapped_file{path}}; }
+
+    size_t size() const {
+        size_t n = 0;
+        for (auto v : pieces_)
+            n += v.size();
+        return n;
+    }
+    bool empty() const { return pieces_.empty(); }
+    std::vector<std::string_view> const& pieces() const { return pieces_; }
+
+    std::string str() const {
+        std::string s;
+        s.reserve(size());
+        for (auto v : pieces_)
+            s.append(v);
+        return s;
+    }
+    void write(std::ostream& os) const {
+        for (auto v : pieces_)
+            os.write(v.data(), static_cast<std::streamsize>(v.size()));
+    }
+    void write_file(std::string const& path) const {
+        std::ofstream os{path, std::ios::binary};
+        write(os);
+        if (!os)
+            throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    bool operator == (piece_text const& other) const { return str() == other.str(); }
+    bool operator == (std::string_view s) const { return str() == s; }
+
+    friend std::ostream& operator << (std::ostream& os, piece_text const& v) {
+        return os << std::quoted(v.str()) << "_pt";
+    }
+
+    // position of the leftmost occurrence: offset in a piece
+    struct position {
+        size_t piece = std::string::npos;
+        size_t off = 0;
+    };
+
+    position find(std::string_view s) const {
+        if (s.empty())
+            return {0, 0};
+        std::string window;
+        for (size_t k = 0; k != pieces_.size(); ++k) {
+            std::string_view v = pieces_[k];
+            size_t p = v.find(s);
+            if (p != std::string_view::npos)
+                return {k, p};
+            // occurrences that start in the tail of this piece and cross its end
+            size_t from = v.size() >= s.size() ? v.size() - s.size() + 1 : 0;
+            size_t starts = v.size() - from;
+            window.assign(v.substr(from));
+            for (size_t j = k + 1; j != pieces_.size() && window.size() < starts + s.size() - 1; ++j)
+                window.append(pieces_[j].substr(0, starts + s.size() - 1 - window.size()));
+            p = window.find(s);
+            if (p != std::string::npos && p < starts)
+                return {k, from + p};
+        }
+        return {};
+    }
+
+    // replaces len chars from the position at with r, which must outlive the text
+    void replace(position at, size_t len, std::string_view r) {
+        std::vector<std::string_view> mid;
+        if (at.off != 0)
+            mid.push_back(pieces_[at.piece].substr(0, at.off));
+        if (!r.empty())
+            mid.push_back(r);
+        size_t j = at.piece;
+        size_t rest = at.off + len;
+        while (j < pieces_.size() && rest >= pieces_[j].size()) {
+            rest -= pieces_[j].size();
+            ++j;
+        }
+        size_t last = j;
+        if (j < pieces_.size()) {
+            mid.push_back(pieces_[j].substr(rest));
+            ++last;
+        }
+        auto it = pieces_.erase(pieces_.begin() + at.piece, pieces_.begin() + last);
+        it = pieces_.insert(it, mid.begin(), mid.end());
+        glue(it - pieces_.begin(), mid.size());
+        if (pieces_.size() >= compact_at_)
+            compact();
+    }
+
+private:
+    struct source {
+        std::string owned;
+        mapped_file mapped;
+        std::string_view view;
+        explicit source(std::string s) : owned{std::move(s)}, view{owned} {}
+        explicit source(mapped_file f) : mapped{std::move(f)}, view{mapped.view()} {}
+    };
+
+    void reset() {
+        pieces_.clear();
+        if (!source_->view.empty())
+            pieces_.push_back(source_->view);
+    }
+
+    // joins the pieces [first-1, first+n] which happen to be adjacent in memory
+    void glue(size_t first, size_t n) {
+        size_t begin = first == 0 ? 0 : first - 1;
+        size_t end = std::min(pieces_.size(), first + n + 1);
+        for (size_t i = begin; i + 1 < end;) {
+            std::string_view a = pieces_[i], b = pieces_[i + 1];
+            if (a.data() + a.size() == b.data()) {
+                pieces_[i] = {a.data(), a.size() + b.size()};
+                pieces_.erase(pieces_.begin() + i + 1);
+                --end;
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    bool is_large_source_piece(std::string_view v) const {
+        std::string_view src = source_->view;
+        return v.size() >= chunk_size / 4 &&
+            v.data() >= src.data() && v.data() + v.size() <= src.data() + src.size();
+    }
+
+    // copies series of short pieces into new own chunks; large pieces of the source stay as is
+    void compact() {
+        std::vector<std::shared_ptr<std::string>> chunks;
+        std::vector<std::string_view> pieces;
+        std::string* chunk = nullptr;
+        for (auto v : pieces_) {
+            if (is_large_source_piece(v)) {
+                pieces.push_back(v);
+                chunk = nullptr;
+                continue;
+            }
+            if (!chunk || chunk->size() + v.size() > chunk_size) {
+                chunks.push_back(std::make_shared<std::string>());
+                chunk = chunks.back().get();
+                chunk->reserve(std::max(chunk_size, v.size())); // never reallocated
+                pieces.push_back({chunk->data(), 0});
+            }
+            chunk->append(v);
+            pieces.back() = {pieces.back().data(), pieces.back().size() + v.size()};
+        }
+        pieces_ = std::move(pieces);
+        chunks_ = std::move(chunks); // old chunks are not referenced anymore
+        compact_at_ = std::max(compact_min_pieces, pieces_.size() * 2);
+    }
+
+    std::shared_ptr<source> source_;
+    std::vector<std::shared_ptr<std::string>> chunks_;
+    std::vector<std::string_view> pieces_;
+    size_t compact_at_ = compact_min_pieces;
+};
+
+// same as try_substitute_inplace for std::string
+bool try_substitute_inplace(CtStr auto cts, CtStr auto ctr, piece_text& text) {
+    constexpr Str auto const& s = cts.value;
+    constexpr Str auto const& r = ctr.value;
+
+    if (s.empty() && r.empty())
+        return true;
+    piece_text::position at = text.find(s.view());
+    if (at.piece == std::string::npos)
+        return false;
+    text.replace(at, s.size(), r.view()); // r has static storage
+    return true;
+}
+
+inline piece_text& inplace_extract_text(piece_text& t) { return t; }
+void inplace_update_text(piece_text& t, auto p) {}
+
+} // namespace nn
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "../concepts.h"
+#include "../ct.h"
+#include "../str.h"
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+namespace nn {
+
+// run-length encoded text is an inplace text for programs
+// that keep long runs of same characters, like unary numbers "<111...1>".
+// it stores maximal runs (char, count): neighbouring runs always have different chars.
+// search and substitution work on runs directly,
+// so time and memory are proportional to the number of runs, not to the length of text.
+
+CONCEPT(RleText)
+
+struct rle_run {
+    char c;
+    size_t n;
+    constexpr bool operator == (rle_run const&) const = default;
+};
+
+struct rle_text {
+    REPRESENTS(RleText)
+
+    std::vector<rle_run> runs;
+
+    constexpr rle_text() = default;
+    constexpr explicit rle_text(std::string_view s) { append(s); }
+
+    constexpr size_t size() const {
+        size_t total = 0;
+        for (auto const& r : runs)
+            total += r.n;
+        return total;
+    }
+    constexpr bool empty() const { return runs.empty(); }
+
+    constexpr std::string str() const {
+        std::string s;
+        s.reserve(size());
+        for (auto const& r : runs)
+            s.append(r.n, r.c);
+        return s;
+    }
+
+    constexpr void append(char c, size_t n) {
+        if (n == 0)
+            return;
+        if (!runs.empty() && runs.back().c == c)
+            runs.back().n += n;
+        else
+            runs.push_back({c, n});
+    }
+    constexpr void append(std::string_view s) {
+        for (char c : s)
+            append(c, 1);
+    }
+
+    constexpr bool operator == (rle_text const&) const = default;
+    constexpr bool operator == (std::string_view s) const { return str() == s; }
+
+    friend std::ostream& operator << (std::ostream& os, rle_text const& v) {
+        return os << std::quoted(v.str()) << "_rle";
+    }
+};
+
+namespace rle_helpers_ns {
+
+constexpr size_t npos = std::string::npos;
+
+// runs of a search string, computed at compile time
+template<Str auto s> constexpr auto runs_of = []{
+    constexpr size_t count = []{
+        size_t k = 0;
+        for (size_t i = 0; i != s.size(); ++i)
+            k += (i == 0 || s[i] != s[i - 1]);
+        return k;
+    }();
+    std::array<rle_run, count> res{};
+    size_t k = 0;
+    for (size_t i = 0; i != s.size(); ++i) {
+        if (i == 0 || s[i] != s[i - 1])
+            res[k++] = {s[i], 0};
+        ++res[k - 1].n;
+    }
+    return res;
+}();
+
+// position of a match: it starts at the offset off of the run i
+struct rle_match {
+    size_t i = npos;
+    size_t off = 0;
+};
+
+// leftmost occurrence of a pattern.
+// a single-run pattern c^n lies inside the first run of c with at least n chars.
+// a multi-run pattern c1^n1 ... cm^nm ends the run i with c1^n1,
+// covers the following m-2 runs exactly, and starts the run i+m-1 with cm^nm.
+constexpr rle_match find_leftmost(std::vector<rle_run> const& text, auto const& pat) {
+    const size_t m = pat.size();
+    if (m == 0)
+        return {0, 0};
+    if (m == 1) {
+        for (size_t i = 0; i != text.size(); ++i)
+            if (text[i].c == pat[0].c && text[i].n >= pat[0].n)
+                return {i, 0};
+        return {};
+    }
+    for (size_t i = 0; i + m <= text.size(); ++i) {
+        if (text[i].c != pat[0].c || text[i].n < pat[0].n)
+            continue;
+        bool ok = true;
+        for (size_t k = 1; ok && k + 1 < m; ++k)
+            ok = text[i + k] == pat[k];
+        ok = ok && text[i + m - 1].c == pat[m - 1].c && text[i + m - 1].n >= pat[m - 1].n;
+        if (ok)
+            return {i, text[i].n - pat[0].n};
+    }
+    return {};
+}
+
+// replaces len chars from the match position with the runs of replacement
+constexpr void replace(std::vector<rle_run>& text, rle_match at, size_t len, auto const& rep) {
+    std::vector<rle_run> mid;
+    auto push = [&](rle_run r) {
+        if (r.n == 0)
+            return;
+        if (!mid.empty() && mid.back().c == r.c)
+            mid.back().n += r.n;
+        else
+            mid.push_back(r);
+    };
+
+    // merge with the left neighbour, because the replacement may start with its char
+    size_t first = at.i;
+    if (first == text.size()) {
+        // empty pattern in empty text
+    } else {
+        if (first > 0) {
+            --first;
+            push(text[first]);
+        }
+        push({text[at.i].c, at.off});
+    }
+    for (auto const& r : rep)
+        push(r);
+
+    // find where the match ends
+    size_t j = at.i;
+    size_t rest = at.off + len;
+    while (j != text.size() && rest >= text[j].n) {
+        rest -= text[j].n;
+        ++j;
+    }
+    size_t last = j;
+    if (j != text.size()) {
+        push({text[j].c, text[j].n - rest});
+        ++last;
+        // merge with the right neighbour too
+        if (last != text.size()) {
+            push(text[last]);
+            ++last;
+        }
+    }
+
+    auto it = text.erase(text.begin() + first, text.begin() + last);
+    text.insert(it, mid.begin(), mid.end());
+}
+
+} // namespace rle_helpers_ns
+
+// same as try_substitute_inplace for std::string
+constexpr bool try_substitute_inplace(CtStr auto cts, CtStr auto ctr, rle_text& text) {
+    constexpr Str auto const& s = cts.value;
+    constexpr Str auto const& r = ctr.value;
+    constexpr auto const& pat = rle_helpers_ns::runs_of<s>;
+    constexpr auto const& rep = rle_helpers_ns::runs_of<r>;
+
+    if (s.empty() && r.empty())
+        return true;
+    rle_helpers_ns::rle_match at = rle_helpers_ns::find_leftmost(text.runs, pat);
+    if (at.i == rle_helpers_ns::npos)
+        return false;
+    rle_helpers_ns::replace(text.runs, at, s.size(), rep);
+    return true;
+}
+
+constexpr rle_text& inplace_extract_text(rle_text& t) { return t; }
+constexpr void inplace_update_text(rle_text& t, auto p) {}
+
+} // namespace nn
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "inplace_trace.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nn {
+
+// process-wide small ids of rule types, for augmentations which keep data per rule
+// (trace events, histograms...): an id is assigned to a type on its first use,
+// later uses cost a check of a static guard.
+
+namespace rule_ids_ns {
+
+struct registry {
+    std::mutex mutex;
+    std::vector<std::string> names;
+
+    static registry& instance() {
+        static registry r;
+        return r;
+    }
+    uint32_t add(std::string name) {
+        std::lock_guard lock{mutex};
+        names.push_back(std::move(name));
+        return static_cast<uint32_t>(names.size() - 1);
+    }
+};
+
+} // namespace rule_ids_ns
+
+template<class P> uint32_t inplace_rule_id(P const& p) {
+    static uint32_t const id = rule_ids_ns::registry::instance().add(trace_ns::rule_name(p));
+    return id;
+}
+
+// name of the rule (as it's printed), empty for an unknown id
+inline std::string inplace_rule_name(uint32_t id) {
+    auto& r = rule_ids_ns::registry::instance();
+    std::lock_guard lock{r.mutex};
+    return id < r.names.size() ? r.names[id] : std::string{};
+}
+
+// ids assigned so far are 0 .. inplace_rule_count()-1
+inline uint32_t inplace_rule_count() {
+    auto& r = rule_ids_ns::registry::instance();
+    std::lock_guard lock{r.mutex};
+    return static_cast<uint32_t>(r.names.size());
+}
+
+} // namespace nn
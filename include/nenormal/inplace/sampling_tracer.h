@@ -0,0 +1,291 @@
+#pragma once
+
+#include "inplace_augmented.h"
+#include "rule_ids.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn {
+
+// sampling of the steps of very long runs: at most `capacity` samples are kept, whatever the length of the run,
+// each with a snippet of the text around the edit of its step, so the memory is bounded by
+// capacity * (sizeof(step_sample) + 4 * radius).
+//
+// modes:
+// - every_nth: steps every, 2*every, 3*every...; when the samples don't fit,
+//   every other one is dropped and the stride doubles (so the samples cover the whole run evenly)
+// - reservoir: a uniform random choice of `capacity` steps of the run (algorithm L:
+//   the steps to skip are drawn in advance, not a random number per step)
+// - interval: the first step after each `interval` of time; when the samples don't fit,
+//   every other one is dropped and the interval doubles
+//
+// a step which isn't taken costs a counter and a comparison (and a read of the clock in the interval mode).
+// a bulk step (a marker walk of n steps) is a single candidate: it is taken or skipped as a whole.
+
+enum class sampling_mode { every_nth, reservoir, interval };
+
+struct sampling_options {
+    sampling_mode mode = sampling_mode::every_nth;
+    size_t capacity = 1024;       // samples kept
+    uint64_t every = 1000;        // every_nth: the initial stride
+    std::chrono::nanoseconds interval = std::chrono::milliseconds{1}; // interval: the initial interval
+    size_t radius = 16;           // bytes of the text kept on each side of the edit
+    uint64_t seed = 1;            // reservoir
+};
+
+struct step_sample {
+    static constexpr uint64_t unknown_pos = ~uint64_t{0};
+
+    uint64_t step = 0;     // number of the step (the last one of a bulk step)
+    uint64_t time_ns = 0;  // since the start of sampling
+    uint64_t pos = unknown_pos; // of the edit
+    uint64_t size = 0;     // size of the text after the step
+    uint32_t rule = 0;     // see inplace_rule_name
+    uint32_t count = 1;    // steps (of a bulk step)
+    std::string snippet;   // the text after the step around the edit (the head of the text if the edit is unknown)
+    size_t offset = 0;     // of the inserted text in the snippet
+    size_t inserted = 0;   // size of the inserted text in the snippet (at most 2 * radius)
+
+    bool operator == (step_sample const&) const = default;
+};
+
+struct sampling_summary {
+    struct rule_share {
+        std::string name;
+        uint64_t samples = 0;
+        double share = 0;  // of the samples, estimates the share of the steps made by the rule
+
+        bool operator == (rule_share const&) const = default;
+    };
+
+    uint64_t steps = 0;    // seen
+    uint64_t samples = 0;  // kept
+    uint64_t min_size = 0; // of the text, over the samples
+    uint64_t max_size = 0;
+    double mean_size = 0;
+    std::vector<rule_share> rules; // by samples, most frequent first
+};
+
+// the samples of a run, owned by the caller (one per thread, like step_latencies)
+class step_sampler {
+    using clock = std::chrono::steady_clock;
+public:
+    explicit step_sampler(sampling_options options = {})
+        : options_{options}, start_{clock::now()}, rng_{options.seed} {
+        options_.capacity = std::max<size_t>(options_.capacity, 2);
+        options_.every = std::max<uint64_t>(options_.every, 1);
+        samples_.reserve(options_.capacity);
+        stride_ = options_.mode == sampling_mode::every_nth ? options_.every : 1;
+        next_ = stride_;
+        interval_ = std::max(std::chrono::duration_cast<clock::duration>(options_.interval), clock::duration{1});
+        next_time_ = start_;
+    }
+
+    sampling_options const& options() const { return options_; }
+    uint64_t steps() const { return steps_; }
+    // current stride of every_nth (in steps), current interval of interval (in ns)
+    uint64_t stride() const {
+        return options_.mode == sampling_mode::interval
+            ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(interval_).count())
+            : stride_;
+    }
+
+    // for the augmentation: counts n steps, false if they aren't sampled
+    bool count(size_t n) {
+        steps_ += n;
+        if (steps_ < next_)
+            return false;
+        if (options_.mode != sampling_mode::interval)
+            return true;
+        next_ = steps_ + 1;
+        now_ = clock::now();
+        return now_ >= next_time_;
+    }
+    // for the augmentation: takes the step(s) counted last
+    void take(uint32_t rule, size_t pos, size_t inserted, std::string const& t, size_t n) {
+        if (options_.mode != sampling_mode::interval)
+            now_ = clock::now();
+        step_sample* s = slot();
+        if (s == nullptr)
+            return;
+        s->step = steps_;
+        s->time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now_ - start_).count());
+        s->pos = pos;
+        s->size = t.size();
+        s->rule = rule;
+        s->count = static_cast<uint32_t>(n);
+        // the snippet reuses the capacity of the replaced sample
+        size_t at = pos == step_sample::unknown_pos ? 0 : std::min(pos, t.size());
+        s->inserted = pos == step_sample::unknown_pos ? 0 : std::min({inserted, 2 * options_.radius, t.size() - at});
+        size_t begin = at - std::min(at, options_.radius);
+        size_t end = pos == step_sample::unknown_pos
+            ? std::min(t.size(), 2 * options_.radius)
+            : std::min(t.size(), at + s->inserted + options_.radius);
+        s->snippet.assign(t, begin, end - begin);
+        s->offset = at - begin;
+    }
+
+    // the samples in the order of steps
+    std::vector<step_sample> samples() const {
+        std::vector<step_sample> r = samples_;
+        std::ranges::sort(r, {}, &step_sample::step);
+        return r;
+    }
+
+    sampling_summary summary() const {
+        sampling_summary r;
+        r.steps = steps_;
+        r.samples = samples_.size();
+        if (samples_.empty())
+            return r;
+        std::vector<uint64_t> by_rule;
+        r.min_size = samples_.front().size;
+        double sum = 0;
+        for (step_sample const& s : samples_) {
+            r.min_size = std::min(r.min_size, s.size);
+            r.max_size = std::max(r.max_size, s.size);
+            sum += static_cast<double>(s.size);
+            if (s.rule >= by_rule.size())
+                by_rule.resize(s.rule + 1);
+            ++by_rule[s.rule];
+        }
+        double total = static_cast<double>(samples_.size());
+        r.mean_size = sum / total;
+        for (size_t i = 0; i != by_rule.size(); ++i)
+            if (by_rule[i] != 0)
+                r.rules.push_back({inplace_rule_name(static_cast<uint32_t>(i)), by_rule[i],
+                                   static_cast<double>(by_rule[i]) / total});
+        std::ranges::stable_sort(r.rules, std::greater{}, &sampling_summary::rule_share::samples);
+        return r;
+    }
+
+    // the summary, then a line per sample: step, rule name, position, size, count, snippet with [the inserted text]
+    std::string report() const {
+        sampling_summary sum = summary();
+        std::ostringstream os;
+        os << "steps=" << sum.steps << " samples=" << sum.samples << " stride=" << stride()
+           << " size: min=" << sum.min_size << " mean=" << static_cast<uint64_t>(sum.mean_size)
+           << " max=" << sum.max_size << '\n';
+        for (auto const& r : sum.rules)
+            os << r.name << "\tsamples=" << r.samples << " share=" << r.share << '\n';
+        for (step_sample const& s : samples()) {
+            os << s.step << '\t' << inplace_rule_name(s.rule) << '\t';
+            if (s.pos == step_sample::unknown_pos)
+                os << '-';
+            else
+                os << s.pos;
+            os << '\t' << s.size << '\t' << s.count << '\t';
+            std::string_view v = s.snippet;
+            auto put = [&](std::string_view part) {
+                for (char c : part)
+                    os << (static_cast<unsigned char>(c) < ' ' ? '.' : c);
+            };
+            put(v.substr(0, s.offset));
+            os << '[';
+            put(v.substr(s.offset, s.inserted));
+            os << ']';
+            put(v.substr(s.offset + s.inserted));
+            os << '\n';
+        }
+        return os.str();
+    }
+
+private:
+    // where to write the sample, nullptr to drop it; moves next_ (and next_time_)
+    step_sample* slot() {
+        switch (options_.mode) {
+        case sampling_mode::every_nth:
+            if (samples_.size() == options_.capacity) {
+                thin_out();
+                stride_ *= 2;
+            }
+            next_ = (steps_ / stride_ + 1) * stride_;
+            // after thinning out, the step may fall between the new strides
+            if (!samples_.empty() && steps_ / stride_ * stride_ <= samples_.back().step)
+                return nullptr;
+            return &samples_.emplace_back();
+        case sampling_mode::interval:
+            if (samples_.size() == options_.capacity) {
+                thin_out();
+                interval_ *= 2;
+            }
+            next_time_ = now_ + interval_;
+            return &samples_.emplace_back();
+        case sampling_mode::reservoir:
+            if (samples_.size() < options_.capacity) {
+                next_ = steps_ + 1;
+                if (samples_.size() + 1 == options_.capacity) {
+                    w_ = std::exp(std::log(uniform()) / static_cast<double>(options_.capacity));
+                    skip();
+                }
+                return &samples_.emplace_back();
+            }
+            {
+                step_sample* s = &samples_[std::uniform_int_distribution<size_t>{0, options_.capacity - 1}(rng_)];
+                w_ *= std::exp(std::log(uniform()) / static_cast<double>(options_.capacity));
+                skip();
+                return s;
+            }
+        }
+        return nullptr;
+    }
+    // keeps every other sample (the later one of each pair)
+    void thin_out() {
+        size_t kept = 0;
+        for (size_t i = 1; i < samples_.size(); i += 2)
+            samples_[kept++] = std::move(samples_[i]);
+        samples_.resize(kept);
+    }
+    // uniform in (0, 1)
+    double uniform() {
+        return (static_cast<double>(rng_() >> 11) + 0.5) * 0x1p-53;
+    }
+    void skip() {
+        double n = std::floor(std::log(uniform()) / std::log1p(-w_));
+        next_ = steps_ + 1 + (n < 0x1p62 ? static_cast<uint64_t>(n) : uint64_t{1} << 62);
+    }
+
+    sampling_options options_;
+    clock::time_point start_;
+    std::vector<step_sample> samples_;
+    uint64_t steps_ = 0;
+    uint64_t next_ = 0;      // the next step to consider
+    uint64_t stride_ = 1;    // every_nth
+    clock::duration interval_{};
+    clock::time_point next_time_;
+    clock::time_point now_;
+    std::mt19937_64 rng_;    // reservoir
+    double w_ = 0;
+};
+
+// the augmentation: writes into the sampler
+struct inplace_sampling_tracer {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
+    REPRESENTS(InplaceEditAugmentation);
+
+    step_sampler* sampler = nullptr;
+
+    void operator()(auto p, std::string const& t) { bulk_edit(p, step_sample::unknown_pos, 0, {}, t, 1); }
+    void bulk(auto p, std::string const& t, size_t n) { bulk_edit(p, step_sample::unknown_pos, 0, {}, t, n); }
+    void edit(auto p, size_t pos, size_t removed, std::string_view inserted, std::string const& t) {
+        bulk_edit(p, pos, removed, inserted, t, 1);
+    }
+    void bulk_edit(auto p, size_t pos, size_t, std::string_view inserted, std::string const& t, size_t n) {
+        if (sampler->count(n))
+            sampler->take(inplace_rule_id(p), pos, inserted.size(), t, n);
+    }
+
+    bool operator == (inplace_sampling_tracer const& other) const { return sampler == other.sampler; }
+};
+
+} // namespace nn
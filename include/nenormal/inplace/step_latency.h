@@ -0,0 +1,157 @@
+#pragma once
+
+#include "inplace_augmented.h"
+#include "rule_ids.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace nn {
+
+// log-linear (hdr-style) histogram of nanoseconds: values below 2^SubBits are exact,
+// above that every power of 2 is split into 2^SubBits buckets (relative error < 2^-SubBits).
+// histograms are plain values: merge those of several threads, query percentiles of the sum.
+
+template<unsigned SubBits = 4> class log_linear_histogram {
+    static constexpr uint64_t sub = uint64_t{1} << SubBits;
+public:
+    static constexpr size_t buckets = (64 - SubBits + 1) * sub;
+
+    static constexpr size_t bucket_of(uint64_t v) {
+        if (v < sub)
+            return static_cast<size_t>(v);
+        unsigned shift = static_cast<unsigned>(std::bit_width(v)) - 1 - SubBits;
+        return static_cast<size_t>((shift + 1) * sub + ((v >> shift) - sub));
+    }
+    // the highest value of the bucket
+    static constexpr uint64_t upper_of(size_t b) {
+        if (b < sub)
+            return b;
+        unsigned shift = static_cast<unsigned>(b / sub - 1);
+        uint64_t mantissa = b % sub + sub;
+        return shift + SubBits + 1 == 64 && mantissa + 1 == 2 * sub
+            ? std::numeric_limits<uint64_t>::max()
+            : ((mantissa + 1) << shift) - 1;
+    }
+
+    void record(uint64_t v, uint64_t n = 1) {
+        counts_[bucket_of(v)] += n;
+        count_ += n;
+        sum_ += v * n;
+        min_ = std::min(min_, v);
+        max_ = std::max(max_, v);
+    }
+    void merge(log_linear_histogram const& other) {
+        for (size_t i = 0; i != buckets; ++i)
+            counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0; }
+
+    // value v such that at least the share q of the values are <= v (within the bucket precision)
+    uint64_t percentile(double q) const {
+        if (count_ == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count_));
+        rank = std::clamp<uint64_t>(rank, 1, count_);
+        uint64_t seen = 0;
+        for (size_t b = 0; b != buckets; ++b) {
+            seen += counts_[b];
+            if (seen >= rank)
+                return std::clamp(upper_of(b), min(), max_);
+        }
+        return max_;
+    }
+
+    bool operator == (log_linear_histogram const&) const = default;
+
+private:
+    std::array<uint64_t, buckets> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+};
+
+using latency_histogram = log_linear_histogram<>;
+
+// latencies of steps: all of them and by the rule (or facade) which made the step
+struct step_latencies {
+    latency_histogram all;
+    std::vector<latency_histogram> by_rule; // index is inplace_rule_id
+
+    latency_histogram& of_rule(uint32_t id) {
+        if (id >= by_rule.size())
+            by_rule.resize(id + 1);
+        return by_rule[id];
+    }
+    void merge(step_latencies const& other) {
+        all.merge(other.all);
+        if (other.by_rule.size() > by_rule.size())
+            by_rule.resize(other.by_rule.size());
+        for (size_t i = 0; i != other.by_rule.size(); ++i)
+            by_rule[i].merge(other.by_rule[i]);
+    }
+
+    // a line per rule (and "all"): count, mean, p50, p99, p999, max in ns
+    std::string report() const {
+        std::ostringstream os;
+        auto line = [&](std::string const& name, latency_histogram const& h) {
+            os << name << "\tcount=" << h.count() << " mean=" << static_cast<uint64_t>(h.mean())
+               << " p50=" << h.percentile(0.5) << " p99=" << h.percentile(0.99)
+               << " p999=" << h.percentile(0.999) << " max=" << h.max() << '\n';
+        };
+        line("all", all);
+        for (size_t i = 0; i != by_rule.size(); ++i)
+            if (by_rule[i].count() != 0)
+                line(inplace_rule_name(static_cast<uint32_t>(i)), by_rule[i]);
+        return os.str();
+    }
+};
+
+// the augmentation: the time of a step is from step_begin (before the loop starts matching)
+// to the report of the step, so it includes the misses of the rules before the one that matched.
+// a bulk step of n steps is recorded as n steps of the average time.
+// it writes into step_latencies owned by the caller (one per thread; merge them afterwards).
+//
+// overhead: two reads of the steady clock and a few increments per step, independent of the text size
+// (some tens of ns with a vdso clock, see the overhead test); a histogram takes 8 KiB per rule.
+struct inplace_step_latency {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
+    using clock = std::chrono::steady_clock;
+
+    step_latencies* out = nullptr;
+    clock::time_point begin = clock::now();
+
+    void step_begin() { begin = clock::now(); }
+
+    void operator()(auto p, std::string const& t) { bulk(p, t, 1); }
+    void bulk(auto p, std::string const&, size_t n) {
+        auto now = clock::now();
+        uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - begin).count());
+        uint64_t each = ns / std::max<size_t>(n, 1);
+        out->all.record(each, n);
+        out->of_rule(inplace_rule_id(p)).record(each, n);
+        begin = now; // in case the loop doesn't call step_begin
+    }
+
+    bool operator == (inplace_step_latency const& other) const { return out == other.out; }
+};
+
+} // namespace nn
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "inplace_augmented.h"
+#include "rule_ids.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace nn {
+
+// asynchronous tracing: the machine thread pushes fixed-size step events into a lock-free
+// single-producer single-consumer ring, a background consumer drains the ring into a sink
+// (formatting, a file, ...), so the hot path costs a clock read and a few stores per step.
+//
+// when the ring is full, the producer
+// - block: waits for the consumer (no event is lost),
+// - drop_oldest: overwrites the oldest unread event,
+// - count_drops: drops the new event;
+// the lost events are counted either way.
+
+struct trace_event {
+    static constexpr uint64_t unknown_pos = ~uint64_t{0};
+
+    uint64_t time_ns = 0; // steady clock (0 if the tracer doesn't take timestamps)
+    uint64_t step = 0;    // number of the step (the last one of a bulk step)
+    uint64_t pos = unknown_pos;  // of the edit (the first step of a bulk step)
+    uint64_t size = 0;    // size of the text after the step
+    uint32_t rule = 0;    // see inplace_rule_name
+    uint32_t count = 1;   // steps (a bulk step is reported at once)
+};
+
+namespace trace_ring_ns {
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace trace_ring_ns
+
+enum class ring_overflow { block, drop_oldest, count_drops };
+
+template<class T> class spsc_ring {
+    static_assert(std::is_trivially_copyable_v<T>);
+public:
+    explicit spsc_ring(size_t capacity, ring_overflow policy = ring_overflow::block)
+        : mask_{std::bit_ceil(std::max<size_t>(capacity, 2)) - 1}, policy_{policy}, slots_(mask_ + 1) {}
+    spsc_ring(spsc_ring const&) = delete;
+    spsc_ring& operator = (spsc_ring const&) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+    ring_overflow policy() const { return policy_; }
+    size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // producer; false if the event was dropped
+    bool push(T const& v) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ > mask_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            while (head - tail_cache_ > mask_) {
+                if (policy_ == ring_overflow::count_drops) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                if (policy_ == ring_overflow::drop_oldest) {
+                    // take the oldest from the consumer (it retries if it was reading it)
+                    if (tail_.compare_exchange_weak(tail_cache_, tail_cache_ + 1, std::memory_order_acq_rel))
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                std::this_thread::yield();
+                tail_cache_ = tail_.load(std::memory_order_acquire);
+            }
+        }
+        slots_[head & mask_] = v;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer; moves up to out.size() events into out, returns their number
+    size_t pop(std::span<T> out) {
+        while (true) {
+            uint64_t tail = tail_.load(std::memory_order_acquire);
+            uint64_t head = head_.load(std::memory_order_acquire);
+            size_t n = static_cast<size_t>(std::min<uint64_t>(head - tail, out.size()));
+            if (n == 0)
+                return 0;
+            for (size_t i = 0; i != n; ++i)
+                out[i] = slots_[(tail + i) & mask_];
+            // with drop_oldest the producer may have taken (and overwritten) some of them meanwhile:
+            // then the copies are discarded
+            if (policy_ != ring_overflow::drop_oldest) {
+                tail_.store(tail + n, std::memory_order_release);
+                return n;
+            }
+            if (tail_.compare_exchange_strong(tail, tail + n, std::memory_order_acq_rel))
+                return n;
+        }
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+private:
+    size_t mask_;
+    ring_overflow policy_;
+    std::vector<T> slots_;
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t tail_cache_ = 0; // producer's view of tail_
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) std::atomic<size_t> dropped_{0};
+};
+
+using trace_ring = spsc_ring<trace_event>;
+
+// background thread which drains the ring into the sink by batches;
+// on destruction (or stop) it drains what's left and joins
+class trace_consumer {
+public:
+    using sink = std::function<void(std::span<trace_event const>)>;
+    static constexpr std::chrono::microseconds idle_wait{200};
+
+    trace_consumer(trace_ring& ring, sink s, size_t batch = 1024)
+        : ring_{ring}, sink_{std::move(s)}, buffer_(std::max<size_t>(batch, 1)),
+          thread_{[this] { work(); }} {}
+    ~trace_consumer() { stop(); }
+    trace_consumer(trace_consumer const&) = delete;
+    trace_consumer& operator = (trace_consumer const&) = delete;
+
+    void stop() {
+        {
+            std::lock_guard lock{mutex_};
+            if (stop_)
+                return;
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+    }
+
+    size_t consumed() const { return consumed_.load(std::memory_order_relaxed); }
+
+private:
+    void work() {
+        while (true) {
+            if (drain())
+                continue;
+            std::unique_lock lock{mutex_};
+            if (stop_)
+                break;
+            wake_.wait_for(lock, idle_wait);
+        }
+        while (drain()) {}
+    }
+    bool drain() {
+        size_t n = ring_.pop(buffer_);
+        if (n == 0)
+            return false;
+        sink_(std::span<trace_event const>{buffer_.data(), n});
+        consumed_.fetch_add(n, std::memory_order_relaxed);
+        return true;
+    }
+
+    trace_ring& ring_;
+    sink sink_;
+    std::vector<trace_event> buffer_;
+    std::atomic<size_t> consumed_{0};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+// sinks
+
+// a line per event: step, rule name, position, size, count, time
+struct trace_text_sink {
+    std::ostream* os;
+
+    void operator()(std::span<trace_event const> events) const {
+        for (trace_event const& e : events) {
+            *os << e.step << '\t' << inplace_rule_name(e.rule) << '\t';
+            if (e.pos == trace_event::unknown_pos)
+                *os << '-';
+            else
+                *os << e.pos;
+            *os << '\t' << e.size << '\t' << e.count << '\t' << e.time_ns << '\n';
+        }
+    }
+};
+
+// raw events (in the byte order of the host)
+struct trace_binary_sink {
+    std::ostream* os;
+
+    void operator()(std::span<trace_event const> events) const {
+        os->write(reinterpret_cast<char const*>(events.data()),
+                  static_cast<std::streamsize>(events.size_bytes()));
+    }
+};
+
+// the augmentation: the producer of a ring (one machine thread per ring)
+struct inplace_ring_tracer {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
+    REPRESENTS(InplaceEditAugmentation);
+
+    trace_ring* ring = nullptr;
+    bool timestamps = true;
+    uint64_t step = 0;
+
+    void operator()(auto p, std::string const& t) { bulk_edit(p, trace_event::unknown_pos, 0, {}, t, 1); }
+    void bulk(auto p, std::string const& t, size_t n) { bulk_edit(p, trace_event::unknown_pos, 0, {}, t, n); }
+    void edit(auto p, size_t pos, size_t removed, std::string_view inserted, std::string const& t) {
+        bulk_edit(p, pos, removed, inserted, t, 1);
+    }
+    void bulk_edit(auto p, size_t pos, size_t, std::string_view, std::string const& t, size_t n) {
+        step += n;
+        ring->push({timestamps ? trace_ring_ns::now_ns() : 0, step, pos,
+                    t.size(), inplace_rule_id(p), static_cast<uint32_t>(n)});
+    }
+
+    bool operator == (inplace_ring_tracer const& other) const { return step == other.step; }
+};
+
+} // namespace nn
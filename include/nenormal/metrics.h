@@ -0,0 +1,340 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn {
+
+// process-wide metrics of the machines, for long-running hosts:
+// - counters: runs, steps of the rule loops, loops stopped by their step limit - in total and per program;
+// - gauges: machines running now and the bytes of their input texts.
+// machine_fun and the rule loops report them by themselves (inplace runs), no augmentation is needed.
+// it is off until machine_metrics::instance().enable(); then a run costs a few relaxed stores.
+//
+// every thread writes its own shard, without contention and read-modify-write atomics;
+// a snapshot sums the shards (and the ones of the finished threads).
+// a program is labelled by its fingerprint key "#" + 16 hex digits (as in the service registry),
+// or by the name given with name_program(); unfingerprinted programs share the label "other".
+//
+// note that steps of a nested loop are counted as well as the steps of the outer loop which ran it.
+
+struct metrics_snapshot {
+    struct program {
+        std::string name;
+        uint64_t runs = 0;
+        uint64_t steps = 0;
+        uint64_t limit_aborts = 0;
+
+        bool operator == (program const&) const = default;
+    };
+
+    uint64_t runs = 0;
+    uint64_t steps = 0;
+    uint64_t limit_aborts = 0;
+    int64_t in_flight = 0;
+    int64_t text_bytes = 0;
+    std::vector<program> programs; // by name
+
+    bool operator == (metrics_snapshot const&) const = default;
+
+    // prometheus text exposition format
+    std::string prometheus() const {
+        std::ostringstream os;
+        auto metric = [&](char const* name, char const* type, char const* help, auto value) {
+            os << "# HELP nenormal_" << name << ' ' << help << "\n# TYPE nenormal_" << name << ' ' << type << '\n'
+               << "nenormal_" << name << ' ' << value << '\n';
+        };
+        metric("runs_total", "counter", "Runs of machines.", runs);
+        metric("steps_total", "counter", "Steps of rule loops.", steps);
+        metric("limit_aborts_total", "counter", "Rule loops stopped by the step limit.", limit_aborts);
+        metric("machines_in_flight", "gauge", "Machines running now.", in_flight);
+        metric("text_bytes", "gauge", "Bytes of the input texts of the machines running now.", text_bytes);
+
+        auto by_program = [&](char const* name, char const* help, uint64_t program::* field) {
+            os << "# HELP nenormal_program_" << name << ' ' << help << "\n# TYPE nenormal_program_" << name << " counter\n";
+            for (program const& p : programs) {
+                os << "nenormal_program_" << name << "{program=\"";
+                for (char c : p.name) {
+                    if (c == '\\' || c == '"')
+                        os << '\\' << c;
+                    else if (c == '\n')
+                        os << "\\n";
+                    else
+                        os << c;
+                }
+                os << "\"} " << p.*field << '\n';
+            }
+        };
+        by_program("runs_total", "Runs of machines by program.", &program::runs);
+        by_program("steps_total", "Steps of rule loops by program.", &program::steps);
+        by_program("limit_aborts_total", "Rule loops stopped by the step limit, by program.", &program::limit_aborts);
+        return os.str();
+    }
+
+    std::string json() const {
+        std::ostringstream os;
+        os << "{\"runs\":" << runs << ",\"steps\":" << steps << ",\"limit_aborts\":" << limit_aborts
+           << ",\"in_flight\":" << in_flight << ",\"text_bytes\":" << text_bytes << ",\"programs\":[";
+        for (size_t i = 0; i != programs.size(); ++i) {
+            program const& p = programs[i];
+            os << (i ? ",{" : "{") << "\"program\":\"";
+            for (char c : p.name) {
+                if (c == '\\' || c == '"') {
+                    os << '\\' << c;
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    os << buf;
+                } else {
+                    os << c;
+                }
+            }
+            os << "\",\"runs\":" << p.runs << ",\"steps\":" << p.steps << ",\"limit_aborts\":" << p.limit_aborts << '}';
+        }
+        os << "]}";
+        return os.str();
+    }
+};
+
+enum class metrics_format { prometheus, json };
+
+namespace metrics_ns {
+
+inline std::atomic<bool> on{false};
+
+// written by the owner thread only, read by any
+template<class T> struct cell {
+    std::atomic<T> v{0};
+    void add(T n) { v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    T get() const { return v.load(std::memory_order_relaxed); }
+};
+
+struct program_cells {
+    cell<uint64_t> runs;
+    cell<uint64_t> steps;
+    cell<uint64_t> limit_aborts;
+};
+
+struct shard {
+    cell<uint64_t> runs;
+    cell<uint64_t> steps;
+    cell<uint64_t> limit_aborts;
+    cell<int64_t> in_flight;
+    cell<int64_t> text_bytes;
+
+    // only the owner grows it, under the mutex (readers take it too)
+    std::mutex mutex;
+    std::vector<std::unique_ptr<program_cells>> programs; // index is the program id
+    program_cells* current = nullptr; // of the machine running on the thread
+
+    program_cells& program(uint32_t id) {
+        if (id >= programs.size() || !programs[id]) {
+            std::lock_guard lock{mutex};
+            if (id >= programs.size())
+                programs.resize(id + 1);
+            programs[id] = std::make_unique<program_cells>();
+        }
+        return *programs[id];
+    }
+};
+
+} // namespace metrics_ns
+
+class machine_metrics {
+public:
+    static machine_metrics& instance() {
+        static machine_metrics m;
+        return m;
+    }
+
+    void enable(bool on = true) { metrics_ns::on.store(on, std::memory_order_relaxed); }
+    bool enabled() const { return metrics_ns::on.load(std::memory_order_relaxed); }
+
+    // dense id of the program with the fingerprint (0 - unfingerprinted)
+    uint32_t program_id(uint64_t fingerprint) {
+        std::lock_guard lock{mutex_};
+        auto [it, added] = ids_.try_emplace(fingerprint, static_cast<uint32_t>(names_.size()));
+        if (added)
+            names_.push_back(fingerprint == 0 ? std::string{"other"} : fingerprint_key(fingerprint));
+        return it->second;
+    }
+    // label of the program in snapshots instead of its fingerprint key
+    void name_program(uint64_t fingerprint, std::string name) {
+        uint32_t id = program_id(fingerprint);
+        std::lock_guard lock{mutex_};
+        names_[id] = std::move(name);
+    }
+
+    metrics_snapshot snapshot() const {
+        std::lock_guard lock{mutex_};
+        metrics_snapshot s = retired_;
+        std::vector<metrics_snapshot::program> programs = retired_programs_;
+        programs.resize(names_.size());
+        for (metrics_ns::shard* sh : shards_) {
+            s.runs += sh->runs.get();
+            s.steps += sh->steps.get();
+            s.limit_aborts += sh->limit_aborts.get();
+            s.in_flight += sh->in_flight.get();
+            s.text_bytes += sh->text_bytes.get();
+            std::lock_guard shard_lock{sh->mutex};
+            for (size_t i = 0; i != sh->programs.size(); ++i) {
+                if (!sh->programs[i])
+                    continue;
+                programs[i].runs += sh->programs[i]->runs.get();
+                programs[i].steps += sh->programs[i]->steps.get();
+                programs[i].limit_aborts += sh->programs[i]->limit_aborts.get();
+            }
+        }
+        // programs of the same name are summed up
+        std::map<std::string, metrics_snapshot::program> by_name;
+        for (size_t i = 0; i != programs.size(); ++i) {
+            if (programs[i].runs == 0 && programs[i].steps == 0)
+                continue;
+            metrics_snapshot::program& p = by_name[names_[i]];
+            p.name = names_[i];
+            p.runs += programs[i].runs;
+            p.steps += programs[i].steps;
+            p.limit_aborts += programs[i].limit_aborts;
+        }
+        for (auto& [name, p] : by_name)
+            s.programs.push_back(std::move(p));
+        return s;
+    }
+
+    std::string text(metrics_format f) const {
+        metrics_snapshot s = snapshot();
+        return f == metrics_format::json ? s.json() : s.prometheus();
+    }
+
+    // writes a snapshot into a temporary file and renames it to path,
+    // so a reader (e.g. a textfile collector) never sees a partial file
+    void write(std::string const& path, metrics_format f) const {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream os{tmp, std::ios::binary | std::ios::trunc};
+            os << text(f);
+            if (!os.flush())
+                throw std::runtime_error("cannot write metrics: " + tmp);
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("cannot write metrics: " + path);
+    }
+
+    // shard of the current thread
+    metrics_ns::shard& local() {
+        thread_local holder h{*this};
+        return h.s;
+    }
+
+    static std::string fingerprint_key(uint64_t fingerprint) {
+        char buf[18];
+        std::snprintf(buf, sizeof(buf), "#%016llx", static_cast<unsigned long long>(fingerprint));
+        return buf;
+    }
+
+private:
+    machine_metrics() = default;
+
+    // registers the shard of a thread; when the thread ends, its counters go to retired_
+    struct holder {
+        machine_metrics& m;
+        metrics_ns::shard s;
+
+        explicit holder(machine_metrics& m) : m{m} {
+            std::lock_guard lock{m.mutex_};
+            m.shards_.push_back(&s);
+        }
+        ~holder() {
+            std::lock_guard lock{m.mutex_};
+            std::erase(m.shards_, &s);
+            m.retired_.runs += s.runs.get();
+            m.retired_.steps += s.steps.get();
+            m.retired_.limit_aborts += s.limit_aborts.get();
+            if (m.retired_programs_.size() < s.programs.size())
+                m.retired_programs_.resize(s.programs.size());
+            for (size_t i = 0; i != s.programs.size(); ++i) {
+                if (!s.programs[i])
+                    continue;
+                m.retired_programs_[i].runs += s.programs[i]->runs.get();
+                m.retired_programs_[i].steps += s.programs[i]->steps.get();
+                m.retired_programs_[i].limit_aborts += s.programs[i]->limit_aborts.get();
+            }
+        }
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<metrics_ns::shard*> shards_;
+    metrics_snapshot retired_; // counters of the finished threads (gauges are back to 0 by then)
+    std::vector<metrics_snapshot::program> retired_programs_;
+    std::map<uint64_t, uint32_t> ids_;
+    std::vector<std::string> names_;
+};
+
+namespace metrics_ns {
+
+template<uint64_t Fingerprint> uint32_t program_id() {
+    static uint32_t const id = machine_metrics::instance().program_id(Fingerprint);
+    return id;
+}
+
+// a run of a machine on the current thread, from the construction to the destruction.
+// a resumed run (fresh = false) isn't counted as a new one.
+template<uint64_t Fingerprint> class machine_run {
+public:
+    explicit machine_run(size_t text_bytes, bool fresh = true) {
+        if (!on.load(std::memory_order_relaxed))
+            return;
+        shard_ = &machine_metrics::instance().local();
+        program_cells& p = shard_->program(program_id<Fingerprint>());
+        if (fresh) {
+            shard_->runs.add(1);
+            p.runs.add(1);
+        }
+        bytes_ = static_cast<int64_t>(text_bytes);
+        shard_->in_flight.add(1);
+        shard_->text_bytes.add(bytes_);
+        outer_ = shard_->current;
+        shard_->current = &p;
+    }
+    ~machine_run() {
+        if (!shard_)
+            return;
+        shard_->in_flight.add(-1);
+        shard_->text_bytes.add(-bytes_);
+        shard_->current = outer_;
+    }
+    machine_run(machine_run const&) = delete;
+    machine_run& operator = (machine_run const&) = delete;
+
+private:
+    shard* shard_ = nullptr;
+    program_cells* outer_ = nullptr;
+    int64_t bytes_ = 0;
+};
+
+// report of a rule loop (to the program of the machine running on the thread, if any)
+inline void loop_finished(size_t steps, bool limit_reached) {
+    if (!on.load(std::memory_order_relaxed))
+        return;
+    shard& s = machine_metrics::instance().local();
+    s.steps.add(steps);
+    s.limit_aborts.add(limit_reached);
+    if (s.current) {
+        s.current->steps.add(steps);
+        s.current->limit_aborts.add(limit_reached);
+    }
+}
+
+} // namespace metrics_ns
+
+} // namespace nn
@@ -9,3 +9,8 @@
 #include "maybe.h"
 #include "substitute.h"
 #include "rules.h"
+#include "inplace/inplace_trace.h"
+#include "inplace/trace_ring.h"
+#include "inplace/step_latency.h"
+#include "inplace/sampling_tracer.h"
+#include "parallel/scheduler.h"
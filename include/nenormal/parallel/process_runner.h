@@ -0,0 +1,273 @@
+#pragma once
+
+#include "thread_pool.h"
+#include "../rules/machine_task.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace nn {
+
+// process runner runs a batch of inputs on forked worker processes (posix),
+// so an input which crashes, hangs or exhausts the memory costs only itself, not the batch.
+//
+// the workers are forked from the calling process for every batch, so they share the program
+// and the inputs copy-on-write. they take input indices from a counter in shared memory,
+// and write the results into a shared arena (status, steps, offset and size per input).
+// the parent is a watchdog: a worker which runs an input longer than the timeout is killed,
+// a worker which dies marks its input as crashed; the parent forks a new worker instead of it,
+// which goes on with the rest of the queue.
+//
+// note: the function runs in the child of fork(), so it must not rely on other threads of the parent.
+
+enum class process_status : uint32_t {
+    pending = 0,
+    ok = 1,
+    error = 2,    // the function threw (text is the message)
+    timeout = 3,  // killed by the watchdog
+    crashed = 4,  // the worker died
+    overflow = 5, // no room for the result in the arena
+};
+
+struct process_result {
+    process_status status = process_status::pending;
+    std::string text;
+    size_t steps = 0;
+
+    bool operator == (process_result const&) const = default;
+};
+
+struct process_runner_options {
+    size_t workers = thread_pool::default_workers() + 1;
+    std::chrono::milliseconds timeout{10000}; // per input
+    size_t memory_limit = 0;                  // address space of a worker incl. the arena, bytes (0 - unlimited)
+    size_t arena = size_t{256} << 20;         // room for the results of a batch (reserved lazily)
+};
+
+class process_runner {
+public:
+    using function = std::function<machine_result(std::string)>;
+
+    explicit process_runner(function f, process_runner_options options = {})
+        : f_{std::move(f)}, options_{options}
+    {
+        if (options_.workers == 0)
+            options_.workers = 1;
+    }
+
+    process_runner_options const& options() const { return options_; }
+    // workers killed or lost (and replaced) so far
+    size_t respawns() const { return respawns_; }
+
+    std::vector<process_result> run(std::span<std::string_view const> inputs) {
+        std::vector<process_result> results(inputs.size());
+        if (inputs.empty())
+            return results;
+        shared s{inputs.size(), options_.workers, options_.arena};
+
+        std::vector<pid_t> pids(std::min(options_.workers, inputs.size()), -1);
+        for (size_t w = 0; w != pids.size(); ++w)
+            pids[w] = spawn(s, w, inputs);
+
+        size_t alive = pids.size();
+        while (alive != 0) {
+            bool changed = false;
+            for (size_t w = 0; w != pids.size(); ++w) {
+                if (pids[w] < 0)
+                    continue;
+                worker_state& ws = s.worker(w);
+                int wstatus = 0;
+                pid_t r = ::waitpid(pids[w], &wstatus, WNOHANG);
+                if (r == 0) {
+                    // running: check its budget
+                    uint64_t current = ws.current.load(std::memory_order_acquire);
+                    if (current == idle || now_ns() - ws.started.load(std::memory_order_acquire) <= timeout_ns())
+                        continue;
+                    ::kill(pids[w], SIGKILL);
+                    ::waitpid(pids[w], &wstatus, 0);
+                    current = ws.current.load(std::memory_order_acquire); // the input it was killed on
+                    if (current != idle)
+                        fail(s, current, process_status::timeout);
+                } else {
+                    uint64_t current = ws.current.load(std::memory_order_acquire);
+                    bool clean = r > 0 && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+                    if (clean && current == idle) {
+                        pids[w] = -1;
+                        --alive;
+                        changed = true;
+                        continue;
+                    }
+                    if (current != idle)
+                        fail(s, current, process_status::crashed);
+                }
+                // replace the worker, if there is work left
+                ws.current.store(idle, std::memory_order_relaxed);
+                changed = true;
+                ++respawns_;
+                if (s.head->next.load() < inputs.size()) {
+                    pids[w] = spawn(s, w, inputs);
+                } else {
+                    pids[w] = -1;
+                    --alive;
+                }
+            }
+            if (!changed && alive != 0)
+                std::this_thread::sleep_for(poll_interval);
+        }
+
+        for (size_t i = 0; i != inputs.size(); ++i) {
+            slot const& sl = s.slot_at(i);
+            process_result& r = results[i];
+            r.status = static_cast<process_status>(sl.status.load(std::memory_order_acquire));
+            if (r.status == process_status::pending)
+                r.status = process_status::crashed; // taken by a worker killed before it told so
+            r.steps = sl.steps;
+            if (r.status == process_status::ok || r.status == process_status::error)
+                r.text.assign(s.arena + sl.offset, sl.size);
+        }
+        return results;
+    }
+
+private:
+    static constexpr uint64_t idle = ~uint64_t{0};
+    static constexpr std::chrono::microseconds poll_interval{200};
+
+    struct header {
+        std::atomic<uint64_t> next{0};
+        std::atomic<uint64_t> arena_used{0};
+    };
+    struct worker_state {
+        std::atomic<uint64_t> current{idle}; // index of the input being run
+        std::atomic<int64_t> started{0};     // when it was taken, ns
+    };
+    struct slot {
+        std::atomic<uint32_t> status{0};
+        uint64_t steps = 0;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    // anonymous shared mapping: header, workers, slots, arena
+    struct shared {
+        void* base = nullptr;
+        size_t bytes = 0;
+        header* head = nullptr;
+        worker_state* workers = nullptr;
+        slot* slots = nullptr;
+        char* arena = nullptr;
+        size_t arena_size = 0;
+
+        shared(size_t n, size_t w, size_t arena_bytes) {
+            size_t fixed = sizeof(header) + w * sizeof(worker_state) + n * sizeof(slot);
+            fixed = (fixed + 63) & ~size_t{63};
+            bytes = fixed + arena_bytes;
+            base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (base == MAP_FAILED)
+                throw std::system_error(errno, std::generic_category(), "mmap");
+            char* p = static_cast<char*>(base);
+            head = new (p) header{};
+            p += sizeof(header);
+            workers = reinterpret_cast<worker_state*>(p);
+            for (size_t i = 0; i != w; ++i)
+                new (workers + i) worker_state{};
+            p += w * sizeof(worker_state);
+            slots = reinterpret_cast<slot*>(p);
+            for (size_t i = 0; i != n; ++i)
+                new (slots + i) slot{};
+            arena = static_cast<char*>(base) + fixed;
+            arena_size = arena_bytes;
+        }
+        ~shared() { ::munmap(base, bytes); }
+        shared(shared const&) = delete;
+        shared& operator = (shared const&) = delete;
+
+        worker_state& worker(size_t w) { return workers[w]; }
+        slot& slot_at(size_t i) { return slots[i]; }
+    };
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    int64_t timeout_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(options_.timeout).count();
+    }
+
+    static void fail(shared& s, uint64_t i, process_status st) {
+        uint32_t expected = static_cast<uint32_t>(process_status::pending);
+        s.slot_at(i).status.compare_exchange_strong(expected, static_cast<uint32_t>(st));
+    }
+
+    static void put(shared& s, slot& sl, process_status st, std::string_view text, size_t steps) {
+        sl.steps = steps;
+        uint64_t offset = s.head->arena_used.load();
+        do {
+            if (offset + text.size() > s.arena_size) {
+                sl.status.store(static_cast<uint32_t>(process_status::overflow), std::memory_order_release);
+                return;
+            }
+        } while (!s.head->arena_used.compare_exchange_weak(offset, offset + text.size()));
+        std::memcpy(s.arena + offset, text.data(), text.size());
+        sl.offset = offset;
+        sl.size = text.size();
+        sl.status.store(static_cast<uint32_t>(st), std::memory_order_release);
+    }
+
+    pid_t spawn(shared& s, size_t w, std::span<std::string_view const> inputs) {
+        std::fflush(nullptr); // buffered output must not be written twice
+        pid_t pid = ::fork();
+        if (pid < 0)
+            throw std::system_error(errno, std::generic_category(), "fork");
+        if (pid != 0)
+            return pid;
+
+        // the worker
+        if (options_.memory_limit != 0) {
+            rlimit rl{options_.memory_limit, options_.memory_limit};
+            ::setrlimit(RLIMIT_AS, &rl);
+        }
+        worker_state& ws = s.worker(w);
+        while (true) {
+            uint64_t i = s.head->next.fetch_add(1);
+            if (i >= inputs.size())
+                break;
+            ws.started.store(now_ns(), std::memory_order_release);
+            ws.current.store(i, std::memory_order_release);
+            slot& sl = s.slot_at(i);
+            try {
+                machine_result r = f_(std::string{inputs[i]});
+                put(s, sl, process_status::ok, r.text, r.steps);
+            } catch (std::exception const& e) {
+                put(s, sl, process_status::error, e.what(), 0);
+            } catch (...) {
+                put(s, sl, process_status::error, "unknown exception", 0);
+            }
+            ws.current.store(idle, std::memory_order_release);
+        }
+        ::_exit(0);
+    }
+
+    function f_;
+    process_runner_options options_;
+    size_t respawns_ = 0;
+};
+
+} // namespace nn
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nn {
+
+// cooperative time-sliced scheduler for many resumable tasks (e.g. machine_task).
+// worker threads take tasks round-robin from a queue and resume each for at most a slice of steps,
+// so a long task cannot monopolize a worker, and the latency of a short task
+// is bounded by the number of the tasks ahead of it, not by their lengths.
+//
+// a task is any movable object with
+// - bool resume(size_t max_steps): true when the task is over,
+// - take() &&: the result, delivered through the future returned by submit.
+// tasks left in the queue on destruction are dropped (their futures get broken_promise).
+
+template<class T> concept ResumableTask =
+    std::movable<T> &&
+    requires (T& t, size_t n) {
+        { t.resume(n) } -> std::convertible_to<bool>;
+        std::move(t).take();
+    };
+
+class scheduler {
+public:
+    static constexpr size_t default_slice = 1024;
+
+    explicit scheduler(size_t workers = thread_pool::default_workers() + 1, size_t slice = default_slice)
+        : slice_{slice == 0 ? 1 : slice}
+    {
+        threads_.reserve(workers);
+        for (size_t i = 0; i != std::max<size_t>(workers, 1); ++i)
+            threads_.emplace_back([this] { work(); });
+    }
+    ~scheduler() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_)
+            t.join();
+    }
+    scheduler(scheduler const&) = delete;
+    scheduler& operator = (scheduler const&) = delete;
+
+    template<ResumableTask T> auto submit(T task) {
+        auto j = std::make_unique<job<T>>(std::move(task));
+        auto f = j->promise.get_future();
+        {
+            std::lock_guard lock{mutex_};
+            queue_.push_back(std::move(j));
+        }
+        wake_.notify_one();
+        return f;
+    }
+
+    size_t slice() const { return slice_; }
+    size_t workers() const { return threads_.size(); }
+    // tasks waiting in the queue (not those being resumed)
+    size_t queued() const {
+        std::lock_guard lock{mutex_};
+        return queue_.size();
+    }
+
+private:
+    struct job_base {
+        virtual ~job_base() = default;
+        // true when it's over (the future is ready)
+        virtual bool resume(size_t n) = 0;
+    };
+    template<class T> struct job : job_base {
+        T task;
+        std::promise<decltype(std::move(std::declval<T&>()).take())> promise;
+
+        explicit job(T t) : task{std::move(t)} {}
+        bool resume(size_t n) override {
+            try {
+                if (!task.resume(n))
+                    return false;
+                promise.set_value(std::move(task).take());
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+            return true;
+        }
+    };
+
+    void work() {
+        while (true) {
+            std::unique_ptr<job_base> j;
+            {
+                std::unique_lock lock{mutex_};
+                wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (stop_)
+                    return;
+                j = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            if (j->resume(slice_))
+                continue;
+            {
+                std::lock_guard lock{mutex_};
+                queue_.push_back(std::move(j)); // to the end of the round
+            }
+            wake_.notify_one();
+        }
+    }
+
+    size_t slice_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::unique_ptr<job_base>> queue_;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace nn
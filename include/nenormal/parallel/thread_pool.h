@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nn {
+
+// persistent pool of worker threads for parallel loops.
+// run(n, f) calls f(0) ... f(n-1) on the workers and the calling thread,
+// and returns when all of them are done.
+// one loop at a time: concurrent callers wait for each other.
+
+class thread_pool {
+public:
+    explicit thread_pool(size_t workers = default_workers()) {
+        threads_.reserve(workers);
+        for (size_t i = 0; i != workers; ++i)
+            threads_.emplace_back([this] { work(); });
+    }
+    ~thread_pool() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_)
+            t.join();
+    }
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator = (thread_pool const&) = delete;
+
+    static size_t default_workers() {
+        size_t n = std::thread::hardware_concurrency();
+        return n > 1 ? n - 1 : 0; // the caller is a worker too
+    }
+    static thread_pool& instance() {
+        static thread_pool pool;
+        return pool;
+    }
+
+    size_t concurrency() const { return threads_.size() + 1; }
+
+    void run(size_t n, std::function<void(size_t)> f) {
+        std::lock_guard loop_lock{loop_mutex_};
+        {
+            std::lock_guard lock{mutex_};
+            task_ = std::move(f);
+            total_ = n;
+            next_ = 0;
+            done_ = 0;
+            ++generation_;
+        }
+        wake_.notify_all();
+        take_tasks();
+        std::unique_lock lock{mutex_};
+        finished_.wait(lock, [&] { return done_ == total_; });
+        task_ = nullptr;
+    }
+
+private:
+    // grabs tasks of the current loop until they are over
+    void take_tasks() {
+        std::unique_lock lock{mutex_};
+        while (next_ < total_) {
+            size_t i = next_++;
+            lock.unlock();
+            task_(i);
+            lock.lock();
+            if (++done_ == total_)
+                finished_.notify_all();
+        }
+    }
+
+    void work() {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock{mutex_};
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_)
+                    return;
+                seen = generation_;
+            }
+            take_tasks();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex loop_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    std::function<void(size_t)> task_;
+    size_t total_ = 0;
+    size_t next_ = 0;
+    size_t done_ = 0;
+    size_t generation_ = 0;
+    bool stop_ = false;
+};
+
+} // namespace nn
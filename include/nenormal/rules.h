@@ -7,11 +7,20 @@
 #include "./rules/rule_series.h"
 #include "./rules/hidden_rule.h"
 #include "./rules/facade_rule.h"
+#include "./rules/flat_program.h"
 #include "./rules/rule_loop.h"
+#include "./rules/bulk_loop.h"
+#include "./rules/parallel_rule.h"
 // macro rule
 #include "./rules/named_rule.h"
 // machine
 #include "./rules/machine.h"
+#include "./rules/machine_task.h"
+#include "./rules/checkpoint.h"
+#include "./rules/memo.h"
+#include "./rules/fingerprint.h"
+#include "./rules/persistent_cache.h"
+#include "./rules/runtime_program.h"
 
 // macros to build a NAM program
 #include "./rules/macros.h"
@@ -7,6 +7,9 @@
 #include "../tristate.h"
 #include "../inplace/inplace_augmented.h"
 #include "../inplace/inplace_tristate.h"
+#include "../inplace/rle_text.h"
+#include "../inplace/piece_text.h"
+#include "../inplace/fingerprinted_text.h"
 
 namespace nn {
 
@@ -35,9 +38,14 @@ template<class T> concept RuleFinalOutput   = MatchedFinalOfTraits<T, is_Machine
 
 // inplace in-out arg
 
-template<class T> concept RuleFixedInput =
+template<class T> concept InplaceStringInput =
     std::same_as<std::remove_cvref_t<T>, std::string> ||
     InplaceAugmented<T>;
+template<class T> concept RuleFixedInput =
+    InplaceStringInput<T> ||
+    RleText<T> ||
+    PieceText<T> ||
+    FingerprintedText<T>;
 CONCEPT_TYPECHECKER(RuleFixedInput);
 template<class T> concept RuleInplaceArg = InplaceOfTraits<T, is_RuleFixedInput>;
 
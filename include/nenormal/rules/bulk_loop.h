@@ -0,0 +1,313 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "flat_program.h"
+#include "flat_loop.h"
+#include "rule_loop.h"
+#include "parallel_rule.h"
+#include "../parallel/thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nn {
+
+// bulk loop does the same as rule_loop<p, Limit>, but it may reduce a group of leaves
+// by a single linear pass instead of one O(n) step per substitution.
+//
+// the group is the longest prefix of the leaves (by priority) which is proven at compile time to be
+// - terminating and step-count invariant: regular leaves that all shorten the text by the same d > 0,
+//   so any reduction of the group from a text takes the same number of steps,
+// - confluent: all the critical pairs (overlaps and inclusions of search strings) are joinable,
+//   so, with termination, the normal form of the group does not depend on the order of substitutions.
+// while any leaf of the group matches, the loop applies only the leaves of the group,
+// so it may bring the text to the normal form of the group in any order.
+// e.g. the pair reducer RULES(RULE("()", ""), RULE("[]", ""), RULE("{}", "")) is such a group.
+//
+// the pass is a stack machine: chars are moved to the output, a search string at its end is replaced,
+// and the replacement is fed back to the input.
+// the augmentation gets a bulk event per leaf with the number of its substitutions in the pass,
+// so a bulk pass is allowed only for augmentations which accept bulk steps (or hidden leaves).
+// a pass that would exceed the limit is discarded, and the rest is done step by step.
+//
+// reductions of disjoint parts of the text are reductions of the whole text,
+// so texts longer than Threshold are cut into segments reduced on several threads,
+// and the seams are repaired by the sequential pass (the result is the same by confluence).
+
+namespace bulk_loop_helpers_ns {
+
+struct string_rule {
+    std::string_view search;
+    std::string_view replace;
+    bool regular;
+};
+
+template<class Leaves> constexpr auto string_rules = [] {
+    std::array<string_rule, Leaves::size> rs{};
+    Leaves::any_of([&](CtSize auto i, auto leaf) {
+        using L = decltype(leaf);
+        rs[i.value] = {L::search.view(), L::replace.view(), L::kind == rule_kind::regular};
+        return false;
+    });
+    return rs;
+}();
+
+template<class Leaves> constexpr size_t max_search = [] {
+    size_t n = 0;
+    for (auto const& r : string_rules<Leaves>)
+        n = std::max(n, r.search.size());
+    return n;
+}();
+
+// fixed-capacity string for compile-time rewriting (words of critical pairs never grow)
+template<size_t N> struct word {
+    std::array<char, N> data{};
+    size_t size = 0;
+
+    constexpr word(auto... parts) { (append(parts), ...); }
+    constexpr std::string_view view() const { return {data.data(), size}; }
+    constexpr void append(std::string_view s) {
+        for (char c : s)
+            data[size++] = c;
+    }
+    // r is not longer than the replaced part
+    constexpr void replace(size_t pos, size_t n, std::string_view r) {
+        for (size_t i = 0; i != r.size(); ++i)
+            data[pos + i] = r[i];
+        for (size_t i = pos + n; i != size; ++i)
+            data[i - n + r.size()] = data[i];
+        size -= n - r.size();
+    }
+};
+
+// normal form of w by the first k rules (which are shortening, so it terminates)
+template<size_t N> constexpr word<N> normalize(word<N> w, auto const& rs, size_t k) {
+    while (true) {
+        bool changed = false;
+        for (size_t i = 0; i != k && !changed; ++i) {
+            size_t pos = w.view().find(rs[i].search);
+            if (pos != std::string_view::npos) {
+                w.replace(pos, rs[i].search.size(), rs[i].replace);
+                changed = true;
+            }
+        }
+        if (!changed)
+            return w;
+    }
+}
+
+template<size_t N> constexpr bool joinable(word<N> const& a, word<N> const& b, auto const& rs, size_t k) {
+    return normalize(a, rs, k).view() == normalize(b, rs, k).view();
+}
+
+// is the group of the first k rules terminating, step-count invariant and confluent
+// (N is enough for two search strings)
+template<size_t N> constexpr bool bulk_safe(auto const& rs, size_t k) {
+    if (k == 0)
+        return false;
+    const size_t d = rs[0].search.size() - std::min(rs[0].search.size(), rs[0].replace.size());
+    for (size_t i = 0; i != k; ++i)
+        if (!rs[i].regular || rs[i].search.size() <= rs[i].replace.size() ||
+            rs[i].search.size() - rs[i].replace.size() != d)
+            return false;
+
+    for (size_t i = 0; i != k; ++i) {
+        for (size_t j = 0; j != k; ++j) {
+            std::string_view li = rs[i].search, lj = rs[j].search;
+            std::string_view ri = rs[i].replace, rj = rs[j].replace;
+            // overlap: a suffix of li is a prefix of lj
+            for (size_t o = 1; o < li.size() && o < lj.size(); ++o) {
+                if (li.substr(li.size() - o) != lj.substr(0, o))
+                    continue;
+                if (!joinable(word<N>{ri, lj.substr(o)}, word<N>{li.substr(0, li.size() - o), rj}, rs, k))
+                    return false;
+            }
+            // inclusion: lj occurs inside li
+            if (i == j || lj.size() > li.size())
+                continue;
+            for (size_t q = 0; q + lj.size() <= li.size(); ++q) {
+                if (li.substr(q, lj.size()) != lj)
+                    continue;
+                if (!joinable(word<N>{ri}, word<N>{li.substr(0, q), rj, li.substr(q + lj.size())}, rs, k))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<class Leaves> constexpr size_t bulk_group_size = [] {
+    constexpr auto const& rs = string_rules<Leaves>;
+    constexpr size_t N = 2 * max_search<Leaves> + 1;
+    size_t best = 0;
+    for (size_t k = 1; k <= rs.size(); ++k)
+        if (bulk_safe<N>(rs, k))
+            best = k;
+    return best;
+}();
+
+template<class Leaves, size_t K> constexpr bool group_hidden = [] {
+    bool hidden = true;
+    Leaves::any_of([&](CtSize auto i, auto leaf) {
+        if constexpr (i.value < K)
+            hidden = hidden && decltype(leaf)::hidden;
+        return false;
+    });
+    return hidden;
+}();
+
+// stack machine bringing a text to the normal form of the group (the first K leaves)
+template<class Leaves, size_t K> struct pass_machine {
+    std::string text; // output
+    std::array<size_t, K> counts{}; // substitutions per leaf
+    size_t steps = 0;
+
+    // appends the input to the normal form.
+    // if the input is in normal form itself, the pass may stop checking
+    // after max_search chars without substitutions: any later occurrence would lie within the input.
+    constexpr void feed(std::string_view in, bool normal_input = false) {
+        std::string pending; // replacements to be fed back, reversed
+        size_t i = 0;
+        size_t quiet = 0; // input chars since the last substitution
+        while (i != in.size() || !pending.empty()) {
+            bool from_input = pending.empty();
+            if (from_input) {
+                if (normal_input && quiet >= max_search<Leaves>) {
+                    text.append(in.substr(i));
+                    return;
+                }
+                text.push_back(in[i++]);
+            } else {
+                text.push_back(pending.back());
+                pending.pop_back();
+            }
+            if (reduce_tail(pending))
+                quiet = 0;
+            else if (from_input)
+                ++quiet;
+        }
+    }
+
+    constexpr void merge_counts(pass_machine const& other) {
+        for (size_t i = 0; i != K; ++i)
+            counts[i] += other.counts[i];
+        steps += other.steps;
+    }
+
+private:
+    constexpr bool reduce_tail(std::string& pending) {
+        return Leaves::any_of([&](CtSize auto l, auto leaf) {
+            if constexpr (l.value < K) {
+                constexpr std::string_view s = decltype(leaf)::search.view();
+                constexpr std::string_view r = decltype(leaf)::replace.view();
+                if (!std::string_view{text}.ends_with(s))
+                    return false;
+                text.resize(text.size() - s.size());
+                pending.append(r.rbegin(), r.rend());
+                ++counts[l.value];
+                ++steps;
+                return true;
+            } else {
+                return false;
+            }
+        });
+    }
+};
+
+template<class Leaves, size_t K>
+constexpr pass_machine<Leaves, K> bulk_pass(std::string_view text) {
+    pass_machine<Leaves, K> m;
+    m.text.reserve(text.size());
+    m.feed(text);
+    return m;
+}
+
+// same pass, but segments of the text are reduced on several threads,
+// then their normal forms are joined by the sequential pass, which only works around the seams
+template<class Leaves, size_t K>
+pass_machine<Leaves, K> parallel_bulk_pass(std::string_view text) {
+    thread_pool& pool = thread_pool::instance();
+    const size_t segments = pool.concurrency();
+    const size_t length = (text.size() + segments - 1) / segments;
+    std::vector<pass_machine<Leaves, K>> parts(segments);
+    pool.run(segments, [&](size_t k) {
+        size_t from = std::min(text.size(), k * length);
+        parts[k] = bulk_pass<Leaves, K>(text.substr(from, length));
+    });
+
+    pass_machine<Leaves, K> m;
+    m.text.reserve(text.size());
+    for (auto& part : parts) {
+        m.feed(part.text, true);
+        m.merge_counts(part);
+        part.text = {};
+    }
+    return m;
+}
+
+} // namespace bulk_loop_helpers_ns
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v, size_t Threshold = parallel_rule_threshold_v>
+struct bulk_loop {
+    REPRESENTS(Rule)
+
+    constexpr RuleOutput auto operator()(RuleInput auto&& nmy) const {
+        return rule_loop_v<p, Limit>(FWD(nmy));
+    }
+
+    constexpr tristate_kind update(RuleFixedInput auto& t) const {
+        if constexpr (Flattenable<decltype(p)> && InplaceStringInput<decltype(t)>) {
+            using leaves = flat_leaves_t<decltype(p)>;
+            constexpr size_t K = bulk_loop_helpers_ns::bulk_group_size<leaves>;
+            if constexpr (K != 0 && (bulk_loop_helpers_ns::group_hidden<leaves, K> || InplaceBulkInput<decltype(t)>))
+                return bulk_update<leaves, K>(t);
+            else
+                return flat_loop<p>::update(t, Limit);
+        } else {
+            return rule_loop_v<p, Limit>.update(t);
+        }
+    }
+
+private:
+    template<class Leaves, size_t K>
+    static constexpr tristate_kind bulk_update(InplaceStringInput auto& t) {
+        std::string& text = inplace_extract_text(t);
+        size_t limit = Limit;
+        while (limit != 0) {
+            auto pass = !std::is_constant_evaluated() && text.size() >= Threshold
+                ? bulk_loop_helpers_ns::parallel_bulk_pass<Leaves, K>(text)
+                : bulk_loop_helpers_ns::bulk_pass<Leaves, K>(text);
+            if (pass.steps == 0) {
+                // no leaf of the group matches: a step of the rest
+                flat_step_result res = flat_loop<p>::step(t, limit);
+                if (res.kind != tristate_kind::matched_regular)
+                    return tristate_kind::matched_final;
+                limit -= res.count;
+                continue;
+            }
+            if (pass.steps > limit)
+                return flat_loop<p>::update(t, limit);
+            text = std::move(pass.text);
+            limit -= pass.steps;
+            Leaves::any_of([&](CtSize auto i, auto leaf) {
+                using L = decltype(leaf);
+                if constexpr (i.value < K && !L::hidden) {
+                    if (pass.counts[i.value] != 0)
+                        inplace_update_text_bulk(t, L::reporter, pass.counts[i.value]);
+                }
+                return false;
+            });
+        }
+        return tristate_kind::not_matched_yet;
+    }
+};
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v, size_t Threshold = parallel_rule_threshold_v>
+constexpr bulk_loop<p, Limit, Threshold> bulk_loop_v{};
+
+} // namespace nn
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../str.h"
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+namespace nn {
+
+// byte histogram of a text is a cheap prefilter for searches:
+// a string cannot occur in the text if it needs some byte more times than the text has it.
+// the histogram is maintained per substitution from the known search and replace strings.
+//
+// byte requirement of a search string is the compile-time list of its distinct bytes with their counts.
+
+struct byte_count {
+    unsigned char byte = 0;
+    size_t count = 0;
+};
+
+template<size_t N> struct byte_requirement {
+    std::array<byte_count, N> counts{};
+    size_t size = 0; // number of distinct bytes
+};
+
+template<Str auto s> constexpr auto byte_requirement_v = [] {
+    byte_requirement<s.size()> req;
+    for (char c : s) {
+        auto b = static_cast<unsigned char>(c);
+        size_t i = 0;
+        while (i != req.size && req.counts[i].byte != b)
+            ++i;
+        if (i == req.size)
+            req.counts[req.size++] = {b, 0};
+        ++req.counts[i].count;
+    }
+    return req;
+}();
+
+class byte_histogram {
+public:
+    constexpr byte_histogram() = default;
+    constexpr explicit byte_histogram(std::string_view text) { add(text); }
+
+    constexpr size_t operator[](unsigned char b) const { return counts_[b]; }
+
+    constexpr void add(std::string_view s) {
+        for (char c : s)
+            ++counts_[static_cast<unsigned char>(c)];
+    }
+    constexpr void remove(std::string_view s) {
+        for (char c : s)
+            --counts_[static_cast<unsigned char>(c)];
+    }
+    // s was replaced by r
+    constexpr void substitute(std::string_view s, std::string_view r) {
+        remove(s);
+        add(r);
+    }
+
+    // false if a string with the requirement surely does not occur
+    template<size_t N> constexpr bool admits(byte_requirement<N> const& req) const {
+        for (size_t i = 0; i != req.size; ++i)
+            if (counts_[req.counts[i].byte] < req.counts[i].count)
+                return false;
+        return true;
+    }
+
+private:
+    std::array<size_t, 256> counts_{};
+};
+
+} // namespace nn
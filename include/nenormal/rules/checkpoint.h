@@ -0,0 +1,244 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "rule_loop.h"
+#include "../inplace/binary_io.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace nn {
+
+// checkpointed machine does the same as MACHINE(p) with the loop limit Limit,
+// but it saves its state every N steps and/or every T of time,
+// so a long run can be resumed after a crash, continuing bit-identically.
+//
+// the state is the text, the number of steps done, the remaining budget of the loop,
+// and the accumulator of the augmentation (which must have save(std::string&) / load(std::string_view)).
+//
+// checkpoints are files written to a temporary name and atomically renamed:
+// - "path" is a full snapshot, tagged by its generation,
+// - "path.delta" is the edit since the full snapshot of the same generation.
+// full snapshots are written every full_every checkpoints, or when a delta gets too large,
+// so the cost of a checkpoint is amortized for local edits of a huge text.
+
+struct checkpoint_policy {
+    std::string path;
+    size_t every_steps = 0;                          // 0 - never by steps
+    std::chrono::steady_clock::duration every_time{}; // 0 - never by time
+    size_t full_every = 16;                          // checkpoints per full snapshot
+};
+
+template<class T> struct machine_state {
+    T text;
+    size_t steps = 0;
+    size_t budget = rule_loop_limit_v;
+    bool finished = false;
+
+    constexpr bool operator == (machine_state const&) const = default;
+};
+
+template<class A> concept SerializableAugmentation =
+    InplaceAugmentation<A> &&
+    requires (A const& a, A& b, std::string& out, std::string_view in) {
+        a.save(out);
+        b.load(in);
+    };
+
+template<class T> concept Checkpointable =
+    std::same_as<T, std::string> ||
+    (InplaceAugmented<T> && SerializableAugmentation<decltype(T::aux)>);
+
+namespace checkpoint_ns {
+
+using namespace binary_io_ns;
+
+constexpr std::string_view magic = "NNCP";
+constexpr unsigned char version = 1;
+
+void put_header(std::string& out, char kind, size_t generation, auto const& s) {
+    out.append(magic);
+    out.push_back(static_cast<char>(version));
+    out.push_back(kind);
+    put_varint(out, generation);
+    put_varint(out, s.steps);
+    put_varint(out, s.budget);
+    out.push_back(s.finished ? 1 : 0);
+}
+
+inline std::string const& text_of(std::string const& t) { return t; }
+std::string const& text_of(InplaceAugmented auto const& t) { return t.text; }
+
+inline std::string aux_bytes(std::string const& t) { return {}; }
+std::string aux_bytes(InplaceAugmented auto const& t) {
+    std::string out;
+    t.aux.save(out);
+    return out;
+}
+inline void load_aux(std::string& t, std::string_view in) {}
+void load_aux(InplaceAugmented auto& t, std::string_view in) { t.aux.load(in); }
+
+inline void write_atomically(std::string const& path, std::string const& data) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream os{tmp, std::ios::binary | std::ios::trunc};
+        os.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!os.flush())
+            throw std::system_error(errno, std::generic_category(), tmp);
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+inline bool read_file(std::string const& path, std::string& data) {
+    std::ifstream is{path, std::ios::binary};
+    if (!is)
+        return false;
+    std::ostringstream ss;
+    ss << is.rdbuf();
+    data = std::move(ss).str();
+    return true;
+}
+
+struct header {
+    char kind;
+    size_t generation;
+    size_t steps;
+    size_t budget;
+    bool finished;
+};
+
+inline header get_header(cursor& c) {
+    for (char m : magic)
+        if (c.get() != m)
+            throw std::runtime_error("not a nenormal checkpoint");
+    if (static_cast<unsigned char>(c.get()) != version)
+        throw std::runtime_error("unsupported checkpoint version");
+    header h;
+    h.kind = c.get();
+    h.generation = c.varint();
+    h.steps = c.varint();
+    h.budget = c.varint();
+    h.finished = c.get() != 0;
+    return h;
+}
+
+// writes full snapshots and deltas against the last full snapshot
+template<class T> struct writer {
+    checkpoint_policy const& policy;
+    size_t generation = 0;
+    size_t since_full = 0;
+    std::string base; // text of the last full snapshot
+
+    void write(machine_state<T> const& s) {
+        std::string const& text = text_of(s.text);
+        text_edit e = text_edit::between(base, text);
+        std::string out;
+        if (generation == 0 || since_full + 1 >= policy.full_every || e.inserted.size() * 2 > text.size()) {
+            ++generation;
+            since_full = 0;
+            put_header(out, 'F', generation, s);
+            put_bytes(out, text);
+            put_bytes(out, aux_bytes(s.text));
+            // if it crashes in between, the previous full snapshot alone is still consistent
+            std::filesystem::remove(policy.path + ".delta");
+            write_atomically(policy.path, out);
+            base = text;
+        } else {
+            ++since_full;
+            put_header(out, 'D', generation, s);
+            put_varint(out, e.pos);
+            put_varint(out, e.erased);
+            put_bytes(out, e.inserted);
+            put_bytes(out, aux_bytes(s.text));
+            write_atomically(policy.path + ".delta", out);
+        }
+    }
+};
+
+} // namespace checkpoint_ns
+
+// loads the last checkpoint into the prototype (which provides the augmentation functions)
+template<Checkpointable T>
+machine_state<T> load_checkpoint(std::string const& path, T prototype) {
+    namespace h = checkpoint_ns;
+    std::string full;
+    if (!h::read_file(path, full))
+        throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), path);
+    h::cursor c{full};
+    h::header fh = h::get_header(c);
+    if (fh.kind != 'F')
+        throw std::runtime_error("corrupted checkpoint");
+
+    machine_state<T> s{std::move(prototype), fh.steps, fh.budget, fh.finished};
+    std::string& text = inplace_extract_text(s.text);
+    text.assign(c.bytes());
+    std::string_view aux = c.bytes();
+
+    std::string delta;
+    if (h::read_file(path + ".delta", delta)) {
+        h::cursor d{delta};
+        h::header dh = h::get_header(d);
+        // a delta of an older generation is outdated
+        if (dh.kind == 'D' && dh.generation == fh.generation && dh.steps >= fh.steps) {
+            text_edit e;
+            e.pos = d.varint();
+            e.erased = d.varint();
+            e.inserted = d.bytes();
+            e.apply(text);
+            aux = d.bytes();
+            s.steps = dh.steps;
+            s.budget = dh.budget;
+            s.finished = dh.finished;
+        }
+    }
+    h::load_aux(s.text, aux);
+    return s;
+}
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v> struct checkpointed_machine {
+    checkpoint_policy policy;
+
+    template<Checkpointable T> T operator()(T t) const {
+        return run(machine_state<T>{std::move(t), 0, Limit}).text;
+    }
+    template<Checkpointable T> T resume(T prototype) const {
+        return run(load_checkpoint(policy.path, std::move(prototype))).text;
+    }
+
+    // same loop as rule_loop<p, Limit>::update, one step of p at a time
+    template<Checkpointable T> machine_state<T> run(machine_state<T> s) const {
+        using clock = std::chrono::steady_clock;
+        checkpoint_ns::writer<T> w{policy};
+        size_t last_steps = s.steps;
+        auto last_time = clock::now();
+
+        while (!s.finished && s.budget != 0) {
+            tristate_kind k = p.update(s.text);
+            if (k == tristate_kind::not_matched_yet)
+                break;
+            ++s.steps;
+            --s.budget;
+            if (k == tristate_kind::matched_final)
+                break;
+
+            bool by_steps = policy.every_steps != 0 && s.steps - last_steps >= policy.every_steps;
+            bool by_time = policy.every_time != clock::duration{} && clock::now() - last_time >= policy.every_time;
+            if (by_steps || by_time) {
+                w.write(s);
+                last_steps = s.steps;
+                last_time = clock::now();
+            }
+        }
+        s.finished = true;
+        w.write(s);
+        return s;
+    }
+};
+
+} // namespace nn
@@ -29,11 +29,28 @@ template<Str auto n, Rule auto p> struct facade_rule {
         }
     }
     constexpr auto update(RuleFixedInput auto& t) const {
-        auto res = p.update(inplace_extract_text(t));
-        if (res != tristate_kind::not_matched_yet) {
-            inplace_update_text(t, *this);
+        if constexpr (InplaceEditInput<decltype(t)>) {
+            // same bare run, but the edit of the step is caught to pass it on
+            // (if p reports it: not if it's hidden or made several steps)
+            inplace_augmented_text<inplace_edit_capture> bare{std::move(t.text), {}};
+            auto res = p.update(bare);
+            t.text = std::move(bare.text);
+            if (res != tristate_kind::not_matched_yet) {
+                if (bare.aux.known()) {
+                    std::string_view inserted = std::string_view{t.text}.substr(bare.aux.pos, bare.aux.inserted);
+                    inplace_update_text_edit(t, *this, bare.aux.pos, bare.aux.removed, inserted);
+                } else {
+                    inplace_update_text(t, *this);
+                }
+            }
+            return res;
+        } else {
+            auto res = p.update(inplace_extract_text(t));
+            if (res != tristate_kind::not_matched_yet) {
+                inplace_update_text(t, *this);
+            }
+            return res;
         }
-        return res;
     }
 };
 
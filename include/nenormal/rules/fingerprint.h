@@ -0,0 +1,123 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "single_rule.h"
+#include "rule_series.h"
+#include "empty_rule.h"
+#include "hidden_rule.h"
+#include "facade_rule.h"
+#include "rule_loop.h"
+#include "parallel_rule.h"
+#include "bulk_loop.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace nn {
+
+// fingerprint of a program is a compile-time hash (FNV-1a, 64 bit)
+// over the structure of the rule: kinds, search and replace strings, names of facades, loop limits.
+// it identifies the behaviour of the program, e.g. to invalidate persistent caches.
+// - named rules are transparent (only their implementation matters),
+// - parallel rules are the same as their nested rules,
+// - bulk loops are the same as rule loops.
+
+namespace fingerprint_ns {
+
+constexpr uint64_t basis = 14695981039346656037ull;
+constexpr uint64_t prime = 1099511628211ull;
+
+constexpr uint64_t mix(uint64_t h, uint64_t v) {
+    for (int i = 0; i != 8; ++i) {
+        h ^= (v >> (i * 8)) & 0xff;
+        h *= prime;
+    }
+    return h;
+}
+constexpr uint64_t mix(uint64_t h, std::string_view s) {
+    h = mix(h, uint64_t{s.size()});
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= prime;
+    }
+    return h;
+}
+
+} // namespace fingerprint_ns
+
+// primary template is incomplete: unknown rules have no fingerprint
+template<class P> struct rule_fingerprint;
+
+template<class P> concept Fingerprinted = requires { rule_fingerprint<std::remove_cvref_t<P>>::value; };
+
+template<Rule auto p> requires Fingerprinted<decltype(p)>
+constexpr uint64_t rule_fingerprint_v = rule_fingerprint<std::remove_cvref_t<decltype(p)>>::value;
+
+template<Str auto s, Str auto r, rule_kind k> struct rule_fingerprint<rule<s, r, k>> {
+    static constexpr uint64_t value = [] {
+        using namespace fingerprint_ns;
+        uint64_t h = mix(basis, "rule");
+        h = mix(h, s.view());
+        h = mix(h, r.view());
+        return mix(h, uint64_t(k));
+    }();
+};
+
+template<> struct rule_fingerprint<empty_rule> {
+    static constexpr uint64_t value = fingerprint_ns::mix(fingerprint_ns::basis, "empty");
+};
+
+template<Rule auto... ps> requires (Fingerprinted<decltype(ps)> && ...)
+struct rule_fingerprint<rules<ps...>> {
+    static constexpr uint64_t value = [] {
+        using namespace fingerprint_ns;
+        uint64_t h = mix(basis, "rules");
+        h = mix(h, uint64_t{sizeof...(ps)});
+        ((h = mix(h, rule_fingerprint_v<ps>)), ...);
+        return h;
+    }();
+};
+
+template<Rule auto p> requires Fingerprinted<decltype(p)>
+struct rule_fingerprint<hidden_rule<p>> {
+    static constexpr uint64_t value =
+        fingerprint_ns::mix(fingerprint_ns::mix(fingerprint_ns::basis, "hidden"), rule_fingerprint_v<p>);
+};
+
+template<Str auto n, Rule auto p> requires Fingerprinted<decltype(p)>
+struct rule_fingerprint<facade_rule<n, p>> {
+    static constexpr uint64_t value = [] {
+        using namespace fingerprint_ns;
+        uint64_t h = mix(basis, "facade");
+        h = mix(h, n.view());
+        return mix(h, rule_fingerprint_v<p>);
+    }();
+};
+
+template<Rule auto p, size_t Limit> requires Fingerprinted<decltype(p)>
+struct rule_fingerprint<rule_loop<p, Limit>> {
+    static constexpr uint64_t value = [] {
+        using namespace fingerprint_ns;
+        uint64_t h = mix(basis, "loop");
+        h = mix(h, uint64_t{Limit});
+        return mix(h, rule_fingerprint_v<p>);
+    }();
+};
+
+template<Rule auto p, size_t Limit, size_t Threshold> requires Fingerprinted<decltype(p)>
+struct rule_fingerprint<bulk_loop<p, Limit, Threshold>> {
+    static constexpr uint64_t value = rule_fingerprint_v<rule_loop_v<p, Limit>>;
+};
+
+template<Rule auto p, size_t Threshold> requires Fingerprinted<decltype(p)>
+struct rule_fingerprint<parallel_rule<p, Threshold>> {
+    static constexpr uint64_t value = rule_fingerprint_v<p>;
+};
+
+// NAMED_RULE
+template<class P> requires requires { P::impl; } && Fingerprinted<decltype(P::impl)>
+struct rule_fingerprint<P> {
+    static constexpr uint64_t value = rule_fingerprint_v<P::impl>;
+};
+
+} // namespace nn
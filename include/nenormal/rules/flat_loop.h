@@ -0,0 +1,248 @@
+#pragma once
+
+#include "flat_program.h"
+#include "marker_index.h"
+#include "../usdt.h"
+#include "../metrics.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+
+namespace nn {
+
+// flat loop is the inplace engine of rule_loop for a flattenable program.
+// it does the same as repeated p.update(t), but, knowing the leaves of the program,
+// it may do several steps at once:
+// - marker walk "MX" -> "XM" over a run "MXX...X" is done by a single rotation,
+//   if no leaf of higher priority can interfere
+//   and the augmentation accepts bulk steps (or the leaf is hidden).
+// - a leaf is not searched for, if the byte histogram of the text says it cannot match.
+// - in a long text, a leaf with a rare byte is searched for only around the positions of that byte.
+
+struct flat_step_result {
+    tristate_kind kind = tristate_kind::not_matched_yet; // not_matched_yet if nothing matched
+    size_t leaf = std::string::npos;  // index of the applied leaf
+    size_t pos = std::string::npos;   // position of the (first) substitution
+    size_t count = 0;                 // number of steps done (greater than 1 for bulk steps)
+};
+
+namespace flat_loop_helpers_ns {
+
+constexpr size_t npos = std::string::npos;
+
+// leftmost occurrence, exactly as try_substitute_inplace finds it
+constexpr size_t find_leftmost(std::string const& text, Str auto const& s) {
+    if (text.size() < s.size())
+        return npos;
+    auto it = std::search(text.begin(), text.end(), s.begin(), s.end());
+    if (it == text.end() && !s.empty())
+        return npos;
+    return it - text.begin();
+}
+
+// the text after j steps of a walk started at p over k copies of X:
+// "M X^k" at p becomes "X^j M X^(k-j)", the rest of the text is the same.
+struct walk_view {
+    std::string const& text;
+    std::string_view m;
+    std::string_view x;
+    size_t p;
+    size_t k;
+    size_t j;
+
+    constexpr char operator[](size_t i) const {
+        if (i < p || i >= p + m.size() + k * x.size())
+            return text[i];
+        size_t off = i - p;
+        size_t jx = j * x.size();
+        if (off < jx)
+            return x[off % x.size()];
+        if (off < jx + m.size())
+            return m[off - jx];
+        return x[(off - jx - m.size()) % x.size()];
+    }
+    constexpr bool matches_at(size_t pos, std::string_view s) const {
+        if (pos + s.size() > text.size())
+            return false;
+        for (size_t i = 0; i != s.size(); ++i)
+            if ((*this)[pos + i] != s[i])
+                return false;
+        return true;
+    }
+    // is there any occurrence of s starting in [from, to)
+    constexpr bool occurs_in(size_t from, size_t to, std::string_view s) const {
+        for (size_t pos = from; pos < to; ++pos)
+            if (matches_at(pos, s))
+                return true;
+        return false;
+    }
+};
+
+constexpr size_t start_of_overlap(size_t pos, size_t len) {
+    return pos + 1 >= len ? pos + 1 - len : 0;
+}
+
+} // namespace flat_loop_helpers_ns
+
+template<Rule auto p> requires Flattenable<decltype(p)>
+struct flat_loop {
+    using leaves = flat_leaves_t<decltype(p)>;
+
+    // bytes that may be worth indexing: those of the search strings
+    static constexpr std::array<bool, 256> search_bytes = [] {
+        std::array<bool, 256> bytes{};
+        leaves::any_of([&](CtSize auto, auto leaf) {
+            for (char c : decltype(leaf)::search)
+                bytes[static_cast<unsigned char>(c)] = true;
+            return false;
+        });
+        return bytes;
+    }();
+
+    // number of steps (1..budget) of the walk of leaf I, which is known to match at pos.
+    // step j+1 is valid if, after j steps, the leaf still matches leftmost at pos+j|X|
+    // and no leaf of higher priority matches.
+    // before the step j none of them matched anywhere, so the only new occurrences
+    // are those which overlap the region [pos+(j-1)|X|, pos+(j-1)|X|+|MX|) changed by the step j.
+    template<size_t I, class L>
+    static constexpr size_t walk_length(std::string const& text, size_t pos, size_t budget) {
+        namespace h = flat_loop_helpers_ns;
+        constexpr std::string_view s = L::search.view();
+        constexpr std::string_view m = s.substr(0, L::walk_marker);
+        constexpr std::string_view x = s.substr(L::walk_marker);
+
+        // leaf of higher priority with empty search always matches, so it cannot be here
+        size_t width = s.size();
+        bool has_empty = false;
+        leaves::any_of([&](CtSize auto i, auto leaf) {
+            if constexpr (i.value < I) {
+                width = std::max(width, decltype(leaf)::search.size());
+                has_empty = has_empty || decltype(leaf)::search.empty();
+            }
+            return false;
+        });
+        if (has_empty)
+            return 1;
+
+        size_t k = 1;
+        while (k < budget && pos + m.size() + (k + 1) * x.size() <= text.size() &&
+               std::equal(x.begin(), x.end(), text.begin() + pos + m.size() + k * x.size()))
+            ++k;
+
+        // windows of all the checks are inside the run "M X^k" far from its ends;
+        // in that case the text around them is the same for all j, so it's enough to check once.
+        const size_t end = pos + m.size() + k * x.size();
+        bool interior_checked = false;
+
+        size_t n = 1;
+        for (size_t j = 1; j < k; ++j, ++n) {
+            const size_t prev = pos + (j - 1) * x.size(); // where the step j was applied
+            const size_t next = prev + x.size();          // where the step j+1 is expected
+            const bool interior = prev >= pos + width - 1 && prev + s.size() + width - 1 <= end;
+            if (interior && interior_checked)
+                continue;
+
+            h::walk_view v{text, m, x, pos, k, j};
+            if (v.occurs_in(h::start_of_overlap(prev, s.size()), next, s))
+                break;
+            bool interfered = leaves::any_of([&](CtSize auto i, auto leaf) {
+                if constexpr (i.value < I) {
+                    constexpr std::string_view hs = decltype(leaf)::search.view();
+                    return v.occurs_in(h::start_of_overlap(prev, hs.size()), prev + s.size(), hs);
+                } else {
+                    return false;
+                }
+            });
+            if (interfered)
+                break;
+            interior_checked = interior_checked || interior;
+        }
+        return n;
+    }
+
+    // single step (possibly bulk one, not longer than budget > 0);
+    // hist and index are of the text, kept up to date
+    static constexpr flat_step_result step(RuleFixedInput auto& t, size_t budget, byte_histogram& hist, marker_index& index) {
+        std::string& text = inplace_extract_text(t);
+        flat_step_result res;
+        leaves::any_of([&](CtSize auto i, auto leaf) {
+            using L = decltype(leaf);
+            if (!hist.admits(L::requirement)) {
+                NN_PROBE(rule_miss, L::rule.name.value);
+                return false;
+            }
+            size_t pos = index.anchors(L::requirement)
+                ? index.find_leftmost(text, L::search.view(), L::requirement)
+                : flat_loop_helpers_ns::find_leftmost(text, L::search);
+            if (pos == flat_loop_helpers_ns::npos) {
+                NN_PROBE(rule_miss, L::rule.name.value);
+                return false;
+            }
+            NN_PROBE(rule_match, L::rule.name.value, pos);
+
+            constexpr bool may_walk = L::is_walk && (L::hidden || InplaceBulkInput<decltype(t)>);
+            size_t n = 1;
+            if constexpr (may_walk) {
+                if (budget > 1)
+                    n = walk_length<i.value, L>(text, pos, budget);
+            }
+            if (n == 1) {
+                text.replace(pos, L::search.size(), L::replace.view());
+                hist.substitute(L::search.view(), L::replace.view());
+                index.substitute(text, pos, L::search.size(), L::replace.size());
+                NN_PROBE(substitute, L::rule.name.value, pos,
+                         static_cast<ptrdiff_t>(L::replace.size()) - static_cast<ptrdiff_t>(L::search.size()));
+                if constexpr (!L::hidden)
+                    inplace_update_text_edit(t, L::reporter, pos, L::search.size(), L::replace.view());
+            } else if constexpr (may_walk) {
+                size_t len = L::walk_marker + n * L::walk_step;
+                auto first = text.begin() + pos;
+                std::rotate(first, first + L::walk_marker, first + len); // same bytes
+                index.rewrite(text, pos, len);
+                NN_PROBE(substitute, L::rule.name.value, pos, ptrdiff_t{0});
+                if constexpr (!L::hidden)
+                    inplace_update_text_bulk_edit(t, L::reporter, n, pos, len, std::string_view{text}.substr(pos, len));
+            }
+
+            res.kind = L::kind == rule_kind::regular ? tristate_kind::matched_regular : tristate_kind::matched_final;
+            res.leaf = i.value;
+            res.pos = pos;
+            res.count = n;
+            return true;
+        });
+        return res;
+    }
+
+    // same, for a single step (the histogram and the index are built from scratch)
+    static constexpr flat_step_result step(RuleFixedInput auto& t, size_t budget) {
+        byte_histogram hist{inplace_extract_text(t)};
+        marker_index index{inplace_extract_text(t), hist, search_bytes};
+        return step(t, budget, hist, index);
+    }
+
+    // same as rule_loop<p, limit>::update
+    static constexpr tristate_kind update(RuleFixedInput auto& t, size_t limit) {
+        byte_histogram hist{inplace_extract_text(t)};
+        marker_index index{inplace_extract_text(t), hist, search_bytes};
+        size_t const budget = limit;
+        tristate_kind kind = tristate_kind::not_matched_yet;
+        while (limit != 0) {
+            NN_PROBE(loop_iteration, budget - limit, inplace_extract_text(t).size());
+            inplace_step_begin(t);
+            flat_step_result res = step(t, limit, hist, index);
+            limit -= res.count;
+            if (res.kind != tristate_kind::matched_regular) {
+                kind = tristate_kind::matched_final;
+                break;
+            }
+        }
+        if !consteval {
+            metrics_ns::loop_finished(budget - limit, kind == tristate_kind::not_matched_yet);
+        }
+        return kind;
+    }
+};
+
+} // namespace nn
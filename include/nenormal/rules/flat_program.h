@@ -0,0 +1,146 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "single_rule.h"
+#include "rule_series.h"
+#include "empty_rule.h"
+#include "hidden_rule.h"
+#include "facade_rule.h"
+#include "../str_algo.h"
+#include "byte_histogram.h"
+
+#include <utility>
+
+namespace nn {
+
+// flat program is a compile-time view of a rule as a plain list of single rules (leaves)
+// in the order of their priority.
+// a step of the flat program is the same as a step of the original rule:
+// the first leaf that matches is applied to the leftmost occurrence of its search string.
+//
+// each leaf remembers who reports its success to the augmentation:
+// - the single rule itself,
+// - the outermost facade rule above it,
+// - nobody, if there is a hidden rule above it (or above the facade).
+//
+// rule loops and unknown rules cannot be flattened.
+
+struct self_reporter {};   // leaf reports itself
+struct hidden_reporter {}; // leaf is hidden from the augmentation
+
+template<SingleRule R, class Reporter> struct rule_leaf {
+    static constexpr R rule{};
+    static constexpr Str auto search = R::ct_search.value;
+    static constexpr Str auto replace = R::ct_replace.value;
+    static constexpr rule_kind kind = R::ct_kind.value;
+
+    using reporter_type = std::conditional_t<std::same_as<Reporter, self_reporter>, R, Reporter>;
+    static constexpr reporter_type reporter{};
+    static constexpr bool hidden = std::same_as<Reporter, hidden_reporter>;
+
+    // bytes the text must have for the search to succeed
+    static constexpr auto requirement = byte_requirement_v<search>;
+
+    // marker walk is a self-repeating transposition "MX" -> "XM":
+    // after each step the marker M stands before the next X (if any),
+    // so the rule may fire again one |X| to the right.
+    // walk_marker is |M|, or 0 if the leaf is not a walk.
+    static constexpr size_t walk_marker = []{
+        if (kind != rule_kind::regular || search.size() != replace.size())
+            return size_t{0};
+        constexpr size_t n = search.size();
+        for (size_t m = 1; m < n; ++m) {
+            bool rotated = true;
+            for (size_t i = 0; i != n && rotated; ++i)
+                rotated = replace[i] == search[(i + m) % n];
+            if (rotated)
+                return m;
+        }
+        return size_t{0};
+    }();
+    static constexpr bool is_walk = walk_marker != 0;
+    static constexpr size_t walk_step = is_walk ? search.size() - walk_marker : 0; // |X|
+};
+
+template<class... Leaves> struct leaf_list {
+    static constexpr size_t size = sizeof...(Leaves);
+
+    // calls f(ct_size_v<i>, leaf_i{}) in the order of priority while it returns false
+    static constexpr bool any_of(auto&& f) {
+        return [&]<size_t... Is>(std::index_sequence<Is...>) {
+            return (f(ct_size_v<Is>, Leaves{}) || ...);
+        }(std::index_sequence_for<Leaves...>{});
+    }
+};
+
+namespace flat_program_helpers {
+
+template<class... Lists> struct concat;
+template<> struct concat<> { using type = leaf_list<>; };
+template<class... Ls> struct concat<leaf_list<Ls...>> { using type = leaf_list<Ls...>; };
+template<class... Ls, class... Ms, class... Lists>
+struct concat<leaf_list<Ls...>, leaf_list<Ms...>, Lists...> {
+    using type = typename concat<leaf_list<Ls..., Ms...>, Lists...>::type;
+};
+
+// the outermost reporter wins
+template<class Current, class Candidate>
+using outer_reporter = std::conditional_t<std::same_as<Current, self_reporter>, Candidate, Current>;
+
+// primary template is incomplete: the rule is not flattenable
+template<class Reporter, class P> struct flatten;
+
+template<class Reporter, class P>
+concept FlattenableAs = requires { typename flatten<Reporter, std::remove_cvref_t<P>>::type; };
+
+template<class Reporter, class P>
+using flatten_t = typename flatten<Reporter, std::remove_cvref_t<P>>::type;
+
+template<class Reporter, Str auto s, Str auto r, rule_kind k>
+struct flatten<Reporter, rule<s, r, k>> {
+    using type = leaf_list<rule_leaf<rule<s, r, k>, Reporter>>;
+};
+
+template<class Reporter>
+struct flatten<Reporter, empty_rule> {
+    using type = leaf_list<>;
+};
+
+template<class Reporter>
+struct flatten<Reporter, rules<>> {
+    using type = leaf_list<>;
+};
+
+template<class Reporter, Rule auto... ps>
+requires (sizeof...(ps) > 0) && (FlattenableAs<Reporter, decltype(ps)> && ...)
+struct flatten<Reporter, rules<ps...>> {
+    using type = typename concat<flatten_t<Reporter, decltype(ps)>...>::type;
+};
+
+template<class Reporter, Rule auto p>
+requires FlattenableAs<hidden_reporter, decltype(p)>
+struct flatten<Reporter, hidden_rule<p>> {
+    using type = flatten_t<hidden_reporter, decltype(p)>;
+};
+
+template<class Reporter, Str auto n, Rule auto p>
+requires FlattenableAs<outer_reporter<Reporter, facade_rule<n, p>>, decltype(p)>
+struct flatten<Reporter, facade_rule<n, p>> {
+    using type = flatten_t<outer_reporter<Reporter, facade_rule<n, p>>, decltype(p)>;
+};
+
+// NAMED_RULE is transparent
+template<class Reporter, class P>
+requires requires { P::impl; } && FlattenableAs<Reporter, decltype(P::impl)>
+struct flatten<Reporter, P> {
+    using type = flatten_t<Reporter, decltype(P::impl)>;
+};
+
+} // namespace flat_program_helpers
+
+template<class P> concept Flattenable =
+    Rule<P> && flat_program_helpers::FlattenableAs<self_reporter, P>;
+
+template<Flattenable P> using flat_leaves_t = flat_program_helpers::flatten_t<self_reporter, P>;
+
+} // namespace nn
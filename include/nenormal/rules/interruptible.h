@@ -0,0 +1,78 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "rule_loop.h"
+#include "flat_loop.h"
+#include "checkpoint.h"
+
+#include <chrono>
+#include <stop_token>
+
+namespace nn {
+
+// interruptible run of a loop: the same steps as rule_loop<p, Limit>::update,
+// but every K steps it checks the stop token and the deadline (so the checks cost next to nothing).
+// an interrupted run returns its state unfinished: the text, the steps done and the remaining budget.
+// the caller may drop it or resume it by passing it back.
+
+constexpr size_t interrupt_check_period_v = 64;
+
+using run_deadline = std::chrono::steady_clock::time_point;
+constexpr run_deadline no_deadline = run_deadline::max();
+
+template<Rule auto p, size_t K = interrupt_check_period_v, RuleFixedInput T>
+requires (K > 0)
+machine_state<T> run_interruptible(machine_state<T> s, std::stop_token stop, run_deadline deadline = no_deadline) {
+    auto interrupted = [&] {
+        return stop.stop_requested() ||
+            (deadline != no_deadline && std::chrono::steady_clock::now() >= deadline);
+    };
+    if (s.finished)
+        return s;
+    if (interrupted())
+        return s;
+
+    size_t since_check = 0;
+    auto checkpoint = [&] {
+        if (++since_check < K)
+            return false;
+        since_check = 0;
+        return interrupted();
+    };
+
+    if constexpr (Flattenable<decltype(p)> && InplaceStringInput<T>) {
+        using loop = flat_loop<p>;
+        std::string& text = inplace_extract_text(s.text);
+        byte_histogram hist{text};
+        marker_index index{text, hist, loop::search_bytes};
+        while (s.budget != 0) {
+            inplace_step_begin(s.text);
+            flat_step_result res = loop::step(s.text, s.budget, hist, index);
+            if (res.kind == tristate_kind::not_matched_yet)
+                break;
+            s.steps += res.count;
+            s.budget -= res.count;
+            if (res.kind == tristate_kind::matched_final)
+                break;
+            if (checkpoint())
+                return s;
+        }
+    } else {
+        while (s.budget != 0) {
+            inplace_step_begin(s.text);
+            tristate_kind k = p.update(s.text);
+            if (k == tristate_kind::not_matched_yet)
+                break;
+            ++s.steps;
+            --s.budget;
+            if (k == tristate_kind::matched_final)
+                break;
+            if (checkpoint())
+                return s;
+        }
+    }
+    s.finished = true;
+    return s;
+}
+
+} // namespace nn
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "rule_concepts.h"
+#include "machine_steps.h"
+#include "interruptible.h"
+#include "fingerprint.h"
+#include "../usdt.h"
+#include "../metrics.h"
 
 namespace nn {
 
@@ -12,15 +17,68 @@ namespace nn {
 
 template<Rule auto p> struct machine_fun {
     REPRESENTS(Machine)
+
+    // key of the program in machine_metrics
+    static constexpr uint64_t metrics_key = [] {
+        if constexpr (Fingerprinted<decltype(p)>)
+            return rule_fingerprint_v<p>;
+        else
+            return uint64_t{0};
+    }();
+
     // rvalue-ref input to optimize a bit
     constexpr MachineData auto operator()(MachineData auto&& t) const {
         return (not_matched_yet{FWD(t)} >> p).value;
     }
     // rvalue input because inside it works as a variable
     constexpr RuleFixedInput auto operator()(RuleFixedInput auto t) const {
-        p.update(t);
+        NN_PROBE(machine_start, inplace_extract_text(t).size());
+        [[maybe_unused]] tristate_kind kind;
+        if consteval {
+            kind = p.update(t);
+        } else {
+            metrics_ns::machine_run<metrics_key> run{inplace_extract_text(t).size()};
+            kind = p.update(t);
+        }
+        NN_PROBE(machine_end, inplace_extract_text(t).size(), static_cast<int>(kind));
         return std::move(t);
     }
+    // runs which may be interrupted by the stop token or the deadline (see interruptible.h);
+    // an unfinished state may be passed back to resume the run
+    template<RuleFixedInput T>
+    machine_state<T> operator()(T t, std::stop_token stop, run_deadline deadline = no_deadline) const {
+        using traits = machine_loop_traits<std::remove_cvref_t<decltype(p)>>;
+        return (*this)(machine_state<T>{std::move(t), 0, traits::limit}, std::move(stop), deadline);
+    }
+    template<RuleFixedInput T>
+    machine_state<T> operator()(T t, run_deadline deadline) const {
+        return (*this)(std::move(t), std::stop_token{}, deadline);
+    }
+    template<RuleFixedInput T>
+    machine_state<T> operator()(machine_state<T> s, std::stop_token stop, run_deadline deadline = no_deadline) const {
+        using traits = machine_loop_traits<std::remove_cvref_t<decltype(p)>>;
+        NN_PROBE(machine_start, inplace_extract_text(s.text).size());
+        {
+            // the loop is run by run_interruptible, so it's reported here
+            metrics_ns::machine_run<metrics_key> run{inplace_extract_text(s.text).size(), s.steps == 0};
+            size_t steps = s.steps;
+            s = run_interruptible<traits::body>(std::move(s), std::move(stop), deadline);
+            metrics_ns::loop_finished(s.steps - steps, s.finished && s.budget == 0);
+        }
+        NN_PROBE(machine_end, inplace_extract_text(s.text).size(),
+                 static_cast<int>(s.finished ? tristate_kind::matched_final : tristate_kind::not_matched_yet));
+        return s;
+    }
+    template<RuleFixedInput T>
+    machine_state<T> operator()(machine_state<T> s, run_deadline deadline) const {
+        return (*this)(std::move(s), std::stop_token{}, deadline);
+    }
+
+    // lazy run of the same machine over t, step by step (see machine_steps.h)
+    generator<step_event> steps(InplaceStringInput auto& t) const {
+        using traits = machine_loop_traits<std::remove_cvref_t<decltype(p)>>;
+        return machine_steps<traits::body, traits::limit>(t);
+    }
 };
 
 template<Rule auto m> constexpr machine_fun<m> machine_fun_v{};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "flat_program.h"
+#include "flat_loop.h"
+#include "rule_loop.h"
+#include "bulk_loop.h"
+#include "../generator.h"
+
+#include <string>
+#include <string_view>
+
+namespace nn {
+
+// machine steps is a lazy run of the inplace machine: a generator of step events.
+// the text is updated in place one step per increment, so the consumer goes at its own pace,
+// may stop at any moment (just stop iterating), or use range algorithms on the steps.
+// there is no buffering and no allocation per step; the views in an event are valid until the next one.
+//
+// for a flattenable rule each event tells the leaf applied, and where;
+// a marker walk of n steps (see flat_loop) is a single event with count n.
+// for other rules the leaf and the position are unknown (npos).
+// the text must not be changed by the consumer during the run.
+
+struct step_event {
+    static constexpr size_t npos = std::string::npos;
+
+    size_t step = 0;               // number of steps done, including this event
+    size_t count = 1;              // number of steps in this event
+    tristate_kind kind = tristate_kind::matched_regular;
+    size_t leaf = npos;            // index of the leaf in the flat program
+    std::string_view search;       // of the leaf
+    std::string_view replace;      // of the leaf
+    size_t pos = npos;             // position of the (first) substitution
+    std::string_view text;         // after the step
+};
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v>
+generator<step_event> machine_steps(InplaceStringInput auto& t) {
+    std::string& text = inplace_extract_text(t);
+    size_t limit = Limit;
+    size_t steps = 0;
+    if constexpr (Flattenable<decltype(p)>) {
+        using loop = flat_loop<p>;
+        byte_histogram hist{text};
+        marker_index index{text, hist, loop::search_bytes};
+        while (limit != 0) {
+            inplace_step_begin(t);
+            flat_step_result res = loop::step(t, limit, hist, index);
+            if (res.kind == tristate_kind::not_matched_yet)
+                co_return;
+            steps += res.count;
+            limit -= res.count;
+            step_event e{steps, res.count, res.kind, res.leaf, {}, {}, res.pos, text};
+            loop::leaves::any_of([&](CtSize auto i, auto leaf) {
+                if (i.value != res.leaf)
+                    return false;
+                e.search = decltype(leaf)::search.view();
+                e.replace = decltype(leaf)::replace.view();
+                return true;
+            });
+            co_yield e;
+            if (res.kind == tristate_kind::matched_final)
+                co_return;
+        }
+    } else {
+        while (limit != 0) {
+            inplace_step_begin(t);
+            tristate_kind k = p.update(t);
+            if (k == tristate_kind::not_matched_yet)
+                co_return;
+            ++steps;
+            --limit;
+            co_yield step_event{steps, 1, k, step_event::npos, {}, {}, step_event::npos, text};
+            if (k == tristate_kind::matched_final)
+                co_return;
+        }
+    }
+}
+
+// a machine runs a loop (or a single step of a rule)
+template<class P> struct machine_loop_traits {
+    static constexpr Rule auto body = P{};
+    static constexpr size_t limit = 1;
+};
+template<Rule auto p, size_t Limit> struct machine_loop_traits<rule_loop<p, Limit>> {
+    static constexpr Rule auto body = p;
+    static constexpr size_t limit = Limit;
+};
+template<Rule auto p, size_t Limit, size_t Threshold> struct machine_loop_traits<bulk_loop<p, Limit, Threshold>> {
+    static constexpr Rule auto body = p;
+    static constexpr size_t limit = Limit;
+};
+
+} // namespace nn
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "rule_loop.h"
+#include "machine_steps.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace nn {
+
+// machine task is a resumable run of MACHINE(p) (with the loop limit Limit) over its own text.
+// resume(n) does at most n steps and returns, so many tasks can share a thread
+// (see parallel/scheduler.h); the state between the slices is kept by the step generator.
+// note that a marker walk (see flat_loop) is done at once, as a single step of the slice.
+
+struct machine_result {
+    std::string text;
+    size_t steps = 0;
+
+    constexpr bool operator == (machine_result const&) const = default;
+};
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v> class machine_task {
+public:
+    explicit machine_task(std::string text) : state_{std::make_unique<state>(std::move(text))} {}
+
+    // true when the run is over
+    bool resume(size_t max_steps) {
+        state& s = *state_;
+        for (; max_steps != 0 && !s.done; --max_steps) {
+            if (!s.started) {
+                s.it = s.events.begin();
+                s.started = true;
+            } else {
+                ++s.it;
+            }
+            if (s.it == s.events.end())
+                s.done = true;
+            else
+                s.steps = s.it->step;
+        }
+        return s.done;
+    }
+
+    bool done() const { return state_->done; }
+    size_t steps() const { return state_->steps; }
+    std::string const& text() const { return state_->text; }
+
+    machine_result take() && { return {std::move(state_->text), state_->steps}; }
+
+private:
+    // the generator refers to the text, so they stay together at a stable address
+    struct state {
+        std::string text;
+        generator<step_event> events = machine_steps<p, Limit>(text);
+        generator<step_event>::iterator it;
+        size_t steps = 0;
+        bool started = false;
+        bool done = false;
+
+        explicit state(std::string t) : text{std::move(t)} {}
+    };
+
+    std::unique_ptr<state> state_;
+};
+
+} // namespace nn
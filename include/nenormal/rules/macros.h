@@ -14,6 +14,9 @@
 #define HIDDEN_RULE(p) (::nn::hidden_rule_v<(p)>)
 #define FACADE_RULE(name, p) (::nn::facade_rule_v<STR(name), (p)>)
 
+// parallel search over huge texts (opt-in, flattenable rules only)
+#define PARALLEL_RULE(p) (::nn::parallel_rule_v<(p)>)
+
 // rule loop
 // (note that rule_loop_body is not a public building block)
 #define RULE_LOOP(r) (::nn::rule_loop_v<(r)>)
@@ -22,3 +25,7 @@
 #define MACHINE_FROM_RULE(r) (::nn::machine_fun_v<(r)>)
 // machine that runs a rule loop is typical use
 #define MACHINE(r) MACHINE_FROM_RULE(RULE_LOOP(r))
+
+// same loop, but confluent groups of rules are reduced by linear passes (opt-in)
+#define BULK_LOOP(r) (::nn::bulk_loop_v<(r)>)
+#define BULK_MACHINE(r) MACHINE_FROM_RULE(BULK_LOOP(r))
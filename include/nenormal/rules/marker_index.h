@@ -0,0 +1,131 @@
+#pragma once
+
+#include "byte_histogram.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn {
+
+// marker index keeps sorted positions of the rare bytes (markers) of a long text,
+// e.g. of "[", "m", "u", "l", "]" in one "[mul]" among 10^5 ones.
+// a search for a string containing a marker is anchored on its rarest marker:
+// only the positions of that marker are checked, so the leftmost occurrence is found
+// in time proportional to the number of markers, not to the length of the text.
+//
+// positions are maintained per substitution; a byte which stops being rare is dropped from the index.
+
+class marker_index {
+public:
+    static constexpr size_t min_text = size_t{1} << 12; // shorter texts are just scanned
+    static constexpr size_t max_share = 64;             // a marker is at most 1/64 of the text
+
+    static constexpr size_t npos = std::string::npos;
+
+    constexpr marker_index() = default;
+
+    // indexes the candidate bytes which are rare in the text
+    constexpr marker_index(std::string_view text, byte_histogram const& hist, std::array<bool, 256> const& candidates) {
+        if (text.size() < min_text)
+            return;
+        size_t limit = text.size() / max_share;
+        for (size_t b = 0; b != 256; ++b) {
+            indexed_[b] = candidates[b] && hist[static_cast<unsigned char>(b)] <= limit;
+            if (indexed_[b])
+                bytes_.push_back(static_cast<unsigned char>(b));
+        }
+        if (!bytes_.empty())
+            add(text, 0, text.size());
+    }
+
+    constexpr bool indexed(unsigned char b) const { return indexed_[b]; }
+    constexpr std::vector<size_t> const& positions(unsigned char b) const { return positions_[b]; }
+
+    // is there a marker to anchor a search with the requirement
+    template<size_t N> constexpr bool anchors(byte_requirement<N> const& req) const {
+        if (bytes_.empty())
+            return false;
+        for (size_t i = 0; i != req.size; ++i)
+            if (indexed_[req.counts[i].byte])
+                return true;
+        return false;
+    }
+
+    // leftmost occurrence of s (which is anchored)
+    template<size_t N> constexpr size_t find_leftmost(std::string_view text, std::string_view s, byte_requirement<N> const& req) const {
+        unsigned char anchor = 0;
+        size_t best = npos;
+        for (size_t i = 0; i != req.size; ++i) {
+            unsigned char b = req.counts[i].byte;
+            if (indexed_[b] && positions_[b].size() < best) {
+                anchor = b;
+                best = positions_[b].size();
+            }
+        }
+        // every occurrence at p has the anchor at p + offset, so candidates are in order
+        size_t offset = s.find(static_cast<char>(anchor));
+        for (size_t q : positions_[anchor]) {
+            if (q < offset)
+                continue;
+            size_t p = q - offset;
+            if (p + s.size() > text.size())
+                break;
+            if (text.substr(p, s.size()) == s)
+                return p;
+        }
+        return npos;
+    }
+
+    // text[pos, pos + erased) was replaced by text[pos, pos + inserted)
+    constexpr void substitute(std::string_view text, size_t pos, size_t erased, size_t inserted) {
+        if (bytes_.empty())
+            return;
+        for (unsigned char b : bytes_) {
+            std::vector<size_t>& v = positions_[b];
+            auto first = std::lower_bound(v.begin(), v.end(), pos);
+            auto last = std::lower_bound(first, v.end(), pos + erased);
+            first = v.erase(first, last);
+            if (erased != inserted)
+                for (auto it = first; it != v.end(); ++it)
+                    *it = *it - erased + inserted;
+        }
+        add(text, pos, pos + inserted);
+        drop_frequent(text.size());
+    }
+
+    // text[pos, pos + len) was rearranged
+    constexpr void rewrite(std::string_view text, size_t pos, size_t len) {
+        substitute(text, pos, len, len);
+    }
+
+private:
+    constexpr void add(std::string_view text, size_t from, size_t to) {
+        for (size_t i = from; i != to; ++i) {
+            auto b = static_cast<unsigned char>(text[i]);
+            if (!indexed_[b])
+                continue;
+            std::vector<size_t>& v = positions_[b];
+            v.insert(std::lower_bound(v.begin(), v.end(), i), i);
+        }
+    }
+
+    constexpr void drop_frequent(size_t text_size) {
+        size_t limit = std::max(text_size, min_text) / max_share;
+        std::erase_if(bytes_, [&](unsigned char b) {
+            if (positions_[b].size() <= limit)
+                return false;
+            indexed_[b] = false;
+            positions_[b] = {};
+            return true;
+        });
+    }
+
+    std::array<bool, 256> indexed_{};
+    std::array<std::vector<size_t>, 256> positions_{};
+    std::vector<unsigned char> bytes_; // indexed ones
+};
+
+} // namespace nn
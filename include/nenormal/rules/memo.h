@@ -0,0 +1,155 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "rule_loop.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace nn {
+
+// transposition table for a batch of runs of the same program.
+// runs often reach texts already seen by other runs (e.g. collatz trajectories merge),
+// so the cache maps an intermediate text to where it ends: the final text and the number of steps.
+//
+// the cache is bounded (the oldest entries are evicted first) and can be shared by threads:
+// it is split into shards, each with its own mutex.
+
+struct memo_entry {
+    std::string final_text;
+    size_t steps = 0; // from the cached text to the final one
+
+    constexpr bool operator == (memo_entry const&) const = default;
+};
+
+class memo_cache {
+public:
+    explicit memo_cache(size_t capacity, size_t shards = 16)
+        : shards_(std::max<size_t>(shards, 1)),
+          shard_capacity_{std::max<size_t>(capacity / shards_.size(), 1)} {}
+
+    std::optional<memo_entry> find(std::string_view text) const {
+        size_t h = std::hash<std::string_view>{}(text);
+        shard const& s = shard_of(h);
+        std::lock_guard lock{s.mutex};
+        auto it = s.entries.find(text);
+        if (it == s.entries.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+
+    void insert(std::string text, memo_entry e) {
+        size_t h = std::hash<std::string_view>{}(text);
+        shard& s = shard_of(h);
+        std::lock_guard lock{s.mutex};
+        auto [it, added] = s.entries.try_emplace(std::move(text), std::move(e));
+        if (!added)
+            return;
+        s.order.push_back(it->first);
+        if (s.order.size() > shard_capacity_) {
+            s.entries.erase(s.entries.find(s.order.front()));
+            s.order.pop_front();
+        }
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (auto const& s : shards_) {
+            std::lock_guard lock{s.mutex};
+            n += s.entries.size();
+        }
+        return n;
+    }
+    size_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    size_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    struct string_hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    struct shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, memo_entry, string_hash, std::equal_to<>> entries;
+        std::deque<std::string_view> order; // keys of entries, oldest first (node keys are stable)
+    };
+
+    shard& shard_of(size_t h) { return shards_[h % shards_.size()]; }
+    shard const& shard_of(size_t h) const { return shards_[h % shards_.size()]; }
+
+    std::vector<shard> shards_;
+    size_t shard_capacity_;
+    mutable std::atomic<size_t> hits_ = 0;
+    mutable std::atomic<size_t> misses_ = 0;
+};
+
+struct memo_result {
+    std::string text;
+    size_t steps = 0;
+
+    constexpr bool operator == (memo_result const&) const = default;
+};
+
+// memoized machine does the same as MACHINE(p) with the loop limit Limit for bare strings.
+// every K steps (at loop iteration boundaries) it looks the current text up in the cache,
+// and after a run that ended by itself (not by the limit) it fills the cache
+// with the texts it has looked up.
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v, size_t K = 16>
+requires (K > 0)
+struct memoized_machine {
+    memo_cache& cache;
+
+    std::string operator()(std::string t) const { return run(std::move(t)).text; }
+
+    memo_result run(std::string t) const {
+        std::vector<std::pair<std::string, size_t>> seen; // text and step where it was seen
+        size_t steps = 0;
+        size_t budget = Limit;
+        bool ended = false;
+        while (true) {
+            if (steps % K == 0) {
+                if (auto e = cache.find(t); e && e->steps <= budget) {
+                    t = std::move(e->final_text);
+                    steps += e->steps;
+                    ended = true;
+                    break;
+                }
+                seen.emplace_back(t, steps);
+            }
+            if (budget == 0)
+                break;
+            tristate_kind k = p.update(t);
+            if (k == tristate_kind::not_matched_yet) {
+                ended = true;
+                break;
+            }
+            ++steps;
+            --budget;
+            if (k == tristate_kind::matched_final) {
+                ended = true;
+                break;
+            }
+        }
+        // runs cut by the limit say nothing about the rest of the way
+        if (ended) {
+            for (auto& [text, at] : seen)
+                cache.insert(std::move(text), {t, steps - at});
+        }
+        return {std::move(t), steps};
+    }
+};
+
+} // namespace nn
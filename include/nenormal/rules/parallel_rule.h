@@ -0,0 +1,121 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "flat_program.h"
+#include "../parallel/thread_pool.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace nn {
+
+// parallel_rule is an opt-in wrapper that searches a huge text on several threads.
+// it does the same step as its nested (flattenable) rule:
+// the first leaf that matches is applied to its leftmost occurrence.
+//
+// the text is split into segments, overlapping by (longest search - 1) chars,
+// so every occurrence starts in exactly one segment.
+// each segment looks for the leaves in the order of priority and stops at the first found,
+// because leaves of lower priority cannot win anyway.
+// then the reduction takes the highest-priority leaf and its leftmost occurrence.
+//
+// texts shorter than Threshold, compile-time and non-string inputs are done serially by p.
+
+constexpr size_t parallel_rule_threshold_v = size_t{1} << 20;
+
+namespace parallel_rule_helpers_ns {
+
+constexpr size_t npos = std::string::npos;
+
+struct segment_result {
+    size_t leaf = npos;
+    size_t pos = npos;
+};
+
+// first leaf which occurs starting in [from, to), and its leftmost position there
+template<class Leaves>
+segment_result search_segment(std::string_view text, size_t from, size_t to) {
+    segment_result res;
+    if (from >= to)
+        return res;
+    Leaves::any_of([&](CtSize auto i, auto leaf) {
+        constexpr std::string_view s = decltype(leaf)::search.view();
+        size_t end = std::min(text.size(), to - 1 + s.size()); // overlap with the next segment
+        if (end < from + s.size())
+            return false;
+        size_t pos = text.substr(from, end - from).find(s);
+        if (pos == std::string_view::npos)
+            return false;
+        res = {i.value, from + pos};
+        return true;
+    });
+    return res;
+}
+
+} // namespace parallel_rule_helpers_ns
+
+template<Rule auto p, size_t Threshold = parallel_rule_threshold_v>
+requires Flattenable<decltype(p)>
+struct parallel_rule {
+    REPRESENTS(Rule)
+
+    using leaves = flat_leaves_t<decltype(p)>;
+
+    constexpr RuleOutput decltype(auto) operator()(RuleInput auto&& nmy) const {
+        return p(FWD(nmy));
+    }
+
+    constexpr tristate_kind update(RuleFixedInput auto& t) const {
+        if constexpr (!InplaceStringInput<decltype(t)>) {
+            return p.update(t);
+        } else {
+            if (std::is_constant_evaluated() || inplace_extract_text(t).size() < Threshold)
+                return p.update(t);
+            return parallel_update(t);
+        }
+    }
+
+    static tristate_kind parallel_update(InplaceStringInput auto& t) {
+        namespace h = parallel_rule_helpers_ns;
+        std::string& text = inplace_extract_text(t);
+
+        thread_pool& pool = thread_pool::instance();
+        const size_t segments = pool.concurrency();
+        const size_t length = (text.size() + segments - 1) / segments;
+        std::vector<h::segment_result> found(segments);
+        pool.run(segments, [&](size_t k) {
+            size_t from = std::min(text.size(), k * length);
+            // the last segment also owns the position past the end (for empty searches)
+            size_t to = (k + 1 == segments) ? text.size() + 1 : std::min(text.size(), from + length);
+            found[k] = h::search_segment<leaves>(text, from, to);
+        });
+
+        h::segment_result best;
+        for (auto const& r : found)
+            if (r.leaf < best.leaf || (r.leaf == best.leaf && r.pos < best.pos))
+                best = r;
+        if (best.leaf == h::npos)
+            return tristate_kind::not_matched_yet;
+
+        tristate_kind kind = tristate_kind::not_matched_yet;
+        leaves::any_of([&](CtSize auto i, auto leaf) {
+            using L = decltype(leaf);
+            if (i.value != best.leaf)
+                return false;
+            text.replace(best.pos, L::search.size(), L::replace.view());
+            if constexpr (!L::hidden)
+                inplace_update_text_edit(t, L::reporter, best.pos, L::search.size(), L::replace.view());
+            kind = L::kind == rule_kind::regular ? tristate_kind::matched_regular : tristate_kind::matched_final;
+            return true;
+        });
+        return kind;
+    }
+};
+
+template<Rule auto p, size_t Threshold = parallel_rule_threshold_v>
+constexpr parallel_rule<p, Threshold> parallel_rule_v{};
+
+} // namespace nn
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "rule_concepts.h"
+#include "fingerprint.h"
+#include "machine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nn {
+
+// persistent cache is a file-backed hash table text -> text (posix),
+// shared by threads and processes running the same program.
+//
+// the file is mapped into memory and consists of
+// - a header: magic, version, program fingerprint, number of buckets, size of the file, end of the log...
+// - buckets: offsets of the newest entries of the chains,
+// - an append-only log of entries: next, hash, key length, value length, key, value.
+//
+// readers are lock-free: an entry is written completely before it's published in its bucket.
+// there is a single writer at a time (a mutex within the process, flock between processes).
+// a newer entry with the same key shadows the older one;
+// when the log is full, compaction copies live entries into a new (maybe larger) file,
+// which replaces the old one atomically; the old one is marked retired, so others reopen.
+// a file written for another program fingerprint is dropped on opening.
+
+class persistent_cache {
+public:
+    static constexpr size_t default_capacity = size_t{64} << 20;
+    static constexpr size_t default_buckets = size_t{1} << 16;
+
+    persistent_cache(std::string path, uint64_t fingerprint,
+                     size_t capacity = default_capacity, size_t buckets = default_buckets)
+        : path_{std::move(path)}, fingerprint_{fingerprint}, capacity_{capacity}, buckets_{buckets}
+    {
+        std::lock_guard lock{writer_};
+        open();
+    }
+
+    uint64_t fingerprint() const { return fingerprint_; }
+    std::string const& path() const { return path_; }
+
+    std::optional<std::string> find(std::string_view key) {
+        while (true) {
+            mapping const& m = *current_.load(std::memory_order_acquire);
+            if (m.retired()) {
+                std::lock_guard lock{writer_};
+                if (current_.load() == &m)
+                    open();
+                continue;
+            }
+            if (auto v = m.find(key, hash(key)))
+                return std::string{*v};
+            return {};
+        }
+    }
+
+    void insert(std::string_view key, std::string_view value) {
+        std::lock_guard lock{writer_};
+        file_lock flock{current_.load()->fd};
+        if (current_.load()->retired())
+            open_locked();
+        uint64_t h = hash(key);
+        if (!current_.load()->append(key, value, h)) {
+            compact_locked(key.size() + value.size());
+            current_.load()->append(key, value, h);
+        }
+    }
+
+    // number of entries in the log, including the shadowed ones
+    size_t entries() const { return current_.load(std::memory_order_acquire)->header().count.load(); }
+
+    void compact() {
+        std::lock_guard lock{writer_};
+        file_lock flock{current_.load()->fd};
+        compact_locked(0);
+    }
+
+private:
+    static constexpr char magic[8] = {'N', 'N', 'P', 'C', 'A', 'C', 'H', 'E'};
+    static constexpr uint64_t version = 1;
+
+    struct header_t {
+        char magic[8];
+        uint64_t version;
+        uint64_t fingerprint;
+        uint64_t buckets;
+        uint64_t size;
+        std::atomic<uint64_t> end; // of the log
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> retired;
+    };
+    static_assert(sizeof(header_t) == 64);
+
+    struct entry_t {
+        uint64_t next;
+        uint64_t hash;
+        uint64_t key_size;
+        uint64_t value_size;
+    };
+
+    static constexpr uint64_t align(uint64_t n) { return (n + 7) & ~uint64_t{7}; }
+    static uint64_t hash(std::string_view key) { return std::hash<std::string_view>{}(key) | 1; }
+
+    struct file_lock {
+        int fd;
+        explicit file_lock(int fd) : fd{fd} { ::flock(fd, LOCK_EX); }
+        ~file_lock() { ::flock(fd, LOCK_UN); }
+    };
+
+    struct mapping {
+        int fd = -1;
+        char* base = nullptr;
+        size_t size = 0;
+
+        ~mapping() {
+            if (base)
+                ::munmap(base, size);
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        header_t& header() const { return *reinterpret_cast<header_t*>(base); }
+        std::atomic<uint64_t>* buckets() const { return reinterpret_cast<std::atomic<uint64_t>*>(base + sizeof(header_t)); }
+        bool retired() const { return header().retired.load(std::memory_order_acquire) != 0; }
+
+        std::optional<std::string_view> find(std::string_view key, uint64_t h) const {
+            uint64_t off = buckets()[h % header().buckets].load(std::memory_order_acquire);
+            while (off != 0) {
+                if (off + sizeof(entry_t) > size)
+                    throw std::runtime_error("corrupted persistent cache");
+                entry_t const& e = *reinterpret_cast<entry_t const*>(base + off);
+                char const* k = base + off + sizeof(entry_t);
+                if (off + sizeof(entry_t) + e.key_size + e.value_size > size)
+                    throw std::runtime_error("corrupted persistent cache");
+                if (e.hash == h && std::string_view{k, e.key_size} == key)
+                    return std::string_view{k + e.key_size, e.value_size};
+                off = e.next;
+            }
+            return {};
+        }
+
+        // false if there is no room
+        bool append(std::string_view key, std::string_view value, uint64_t h) {
+            header_t& hd = header();
+            uint64_t off = hd.end.load(std::memory_order_relaxed);
+            uint64_t len = align(sizeof(entry_t) + key.size() + value.size());
+            if (off + len > size)
+                return false;
+            std::atomic<uint64_t>& bucket = buckets()[h % hd.buckets];
+            entry_t e{bucket.load(std::memory_order_relaxed), h, key.size(), value.size()};
+            std::memcpy(base + off, &e, sizeof(e));
+            std::memcpy(base + off + sizeof(e), key.data(), key.size());
+            std::memcpy(base + off + sizeof(e) + key.size(), value.data(), value.size());
+            hd.end.store(off + len, std::memory_order_relaxed);
+            hd.count.fetch_add(1, std::memory_order_relaxed);
+            bucket.store(off, std::memory_order_release); // publish
+            return true;
+        }
+
+        // calls f(hash, key, value) for the newest entry of every key
+        void for_each_live(auto&& f) const {
+            std::vector<std::string_view> keys;
+            for (uint64_t b = 0; b != header().buckets; ++b) {
+                keys.clear();
+                for (uint64_t off = buckets()[b].load(std::memory_order_acquire); off != 0;) {
+                    entry_t const& e = *reinterpret_cast<entry_t const*>(base + off);
+                    std::string_view k{base + off + sizeof(entry_t), e.key_size};
+                    if (std::find(keys.begin(), keys.end(), k) == keys.end()) {
+                        keys.push_back(k);
+                        f(e.hash, k, std::string_view{k.data() + k.size(), e.value_size});
+                    }
+                    off = e.next;
+                }
+            }
+        }
+    };
+
+    static std::unique_ptr<mapping> map_file(std::string const& path, int fd) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        auto m = std::make_unique<mapping>();
+        m->fd = fd;
+        m->size = static_cast<size_t>(st.st_size);
+        void* p = ::mmap(nullptr, m->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), path);
+        m->base = static_cast<char*>(p);
+        return m;
+    }
+
+    void init_file(std::string const& path, int fd, size_t capacity) {
+        size_t min_size = sizeof(header_t) + buckets_ * sizeof(uint64_t) + 64;
+        capacity = std::max(capacity, min_size);
+        if (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, static_cast<off_t>(capacity)) != 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        header_t h{};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.fingerprint = fingerprint_;
+        h.buckets = buckets_;
+        h.size = capacity;
+        h.end = align(sizeof(header_t) + buckets_ * sizeof(uint64_t));
+        if (::pwrite(fd, &h, sizeof(h), 0) != sizeof(h))
+            throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    bool valid(int fd) const {
+        header_t h;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || ::pread(fd, &h, sizeof(h), 0) != sizeof(h))
+            return false;
+        return std::memcmp(h.magic, magic, sizeof(magic)) == 0 && h.version == version &&
+            h.fingerprint == fingerprint_ && h.size == static_cast<uint64_t>(st.st_size) &&
+            h.retired.load() == 0 && h.buckets != 0;
+    }
+
+    // (writer_ is locked)
+    void open() {
+        int fd = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path_);
+        {
+            file_lock lock{fd};
+            if (!valid(fd))
+                init_file(path_, fd, capacity_); // new file, or another program, or garbage
+        }
+        install(map_file(path_, fd));
+    }
+    // (writer_ and the file are locked)
+    void open_locked() {
+        // the file was replaced by compaction in another process
+        int fd = ::open(path_.c_str(), O_RDWR);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path_);
+        file_lock lock{fd};
+        if (!valid(fd))
+            init_file(path_, fd, capacity_);
+        install(map_file(path_, fd));
+    }
+
+    void install(std::unique_ptr<mapping> m) {
+        // retired mappings stay alive, because lock-free readers may still walk them
+        current_.store(m.get(), std::memory_order_release);
+        mappings_.push_back(std::move(m));
+    }
+
+    // (writer_ and the file are locked)
+    void compact_locked(size_t extra) {
+        mapping& old = *current_.load();
+        size_t live = 0;
+        old.for_each_live([&](uint64_t, std::string_view k, std::string_view v) {
+            live += align(sizeof(entry_t) + k.size() + v.size());
+        });
+        size_t tables = align(sizeof(header_t) + buckets_ * sizeof(uint64_t));
+        size_t needed = tables + live + align(sizeof(entry_t) + extra);
+        capacity_ = std::max(capacity_, needed * 2);
+
+        std::string tmp = path_ + ".tmp";
+        int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), tmp);
+        init_file(tmp, fd, capacity_);
+        auto m = map_file(tmp, fd);
+        old.for_each_live([&](uint64_t h, std::string_view k, std::string_view v) { m->append(k, v, h); });
+        if (::rename(tmp.c_str(), path_.c_str()) != 0)
+            throw std::system_error(errno, std::generic_category(), path_);
+        old.header().retired.store(1, std::memory_order_release);
+        install(std::move(m));
+    }
+
+    std::string path_;
+    uint64_t fingerprint_;
+    size_t capacity_;
+    size_t buckets_;
+    std::mutex writer_;
+    std::atomic<mapping*> current_ = nullptr;
+    std::vector<std::unique_ptr<mapping>> mappings_;
+};
+
+// cached machine runs MACHINE(p) (with the loop limit Limit) through a persistent cache.
+// the cache must be opened with the fingerprint of the same program.
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v>
+struct cached_machine {
+    static constexpr Rule auto loop = rule_loop_v<p, Limit>;
+    static constexpr uint64_t fingerprint = rule_fingerprint_v<loop>;
+
+    persistent_cache& cache;
+
+    explicit cached_machine(persistent_cache& cache) : cache{cache} {
+        if (cache.fingerprint() != fingerprint)
+            throw std::invalid_argument("persistent cache of another program");
+    }
+
+    std::string operator()(std::string t) const {
+        if (auto v = cache.find(t))
+            return std::move(*v);
+        std::string r = machine_fun_v<loop>(t);
+        cache.insert(t, r);
+        return r;
+    }
+};
+
+} // namespace nn
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "rule_concepts.h"
+#include "flat_loop.h"
 #include "../utility.h"
 #include "../scope_exit.h"
+#include "../usdt.h"
+#include "../metrics.h"
 #include <limits>
 
 namespace nn {
@@ -156,15 +159,31 @@ template<Rule auto p, size_t Limit = rule_loop_limit_v> struct rule_loop {
         return FWD(nmy) >> rule_loop_helpers_ns::repeat_body<body, Limit, Unroll, Multiply>{};
     }
     constexpr tristate_kind update(RuleFixedInput auto& t) const {
-        constexpr auto body = rule_loop_helpers_ns::rule_loop_body<p>{};
-        inplace_argument<decltype(t)> a{t};
-        size_t limit = Limit;
-        while (!a) {
-            if (limit == 0) break;
-            --limit;
-            a.updated_by(body);
+        if constexpr (Flattenable<decltype(p)> && InplaceStringInput<decltype(t)>) {
+            // same loop, but it can accelerate some series of steps
+            return flat_loop<p>::update(t, Limit);
+        } else {
+            // same as repeated rule_loop_body<p>, but counting the steps
+            size_t limit = Limit;
+            size_t steps = 0;
+            tristate_kind kind = tristate_kind::not_matched_yet;
+            while (limit != 0) {
+                --limit;
+                NN_PROBE(loop_iteration, steps, inplace_extract_text(t).size());
+                inplace_step_begin(t);
+                tristate_kind k = p.update(t);
+                if (k != tristate_kind::not_matched_yet)
+                    ++steps;
+                if (k != tristate_kind::matched_regular) {
+                    kind = tristate_kind::matched_final;
+                    break;
+                }
+            }
+            if !consteval {
+                metrics_ns::loop_finished(steps, kind == tristate_kind::not_matched_yet);
+            }
+            return kind;
         }
-        return a.kind;
     }
 };
 
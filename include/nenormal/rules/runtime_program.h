@@ -0,0 +1,210 @@
+#pragma once
+
+#include "rule_loop.h"
+#include "machine_task.h"
+#include "../inplace/mapped_file.h"
+#include "../usdt.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn {
+
+// runtime program is a normal algorithm loaded at run time (e.g. from a rule file),
+// with the semantics of MACHINE(RULES(...)) over plain rules:
+// every step applies the first rule which matches (at its leftmost occurrence);
+// the run stops on a final rule, when no rule matches, or when the limit of steps is reached.
+//
+// rule file: a rule per line, "search -> replace" or "search ->. replace" (final);
+// a side is either a bare word (no spaces, no quotes) or a quoted string with escapes
+// \\ \" \n \r \t \0 \xHH; an omitted side is empty. '#' starts a comment (outside of quotes).
+//
+//   # correct bracket sequence
+//   ()   -> ""
+//   (    -> _
+//   )    -> _
+//   __   -> _
+//   _    ->. ERROR
+//   ""   ->. OK
+
+struct runtime_rule {
+    std::string search;
+    std::string replace;
+    bool final = false;
+
+    bool operator == (runtime_rule const&) const = default;
+};
+
+namespace runtime_program_ns {
+
+struct token {
+    std::string text;
+    bool quoted = false;
+};
+
+[[noreturn]] inline void fail(size_t line, std::string const& what) {
+    throw std::invalid_argument("line " + std::to_string(line) + ": " + what);
+}
+
+inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+inline std::vector<token> tokenize(std::string_view s, size_t line) {
+    std::vector<token> tokens;
+    size_t i = 0;
+    auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    while (true) {
+        while (i != s.size() && space(s[i]))
+            ++i;
+        if (i == s.size() || s[i] == '#')
+            return tokens;
+        token t;
+        if (s[i] != '"') {
+            while (i != s.size() && !space(s[i]) && s[i] != '"' && s[i] != '#')
+                t.text.push_back(s[i++]);
+            tokens.push_back(std::move(t));
+            continue;
+        }
+        t.quoted = true;
+        for (++i;; ++i) {
+            if (i == s.size())
+                fail(line, "unterminated string");
+            char c = s[i];
+            if (c == '"')
+                break;
+            if (c != '\\') {
+                t.text.push_back(c);
+                continue;
+            }
+            if (++i == s.size())
+                fail(line, "unterminated string");
+            switch (s[i]) {
+            case '\\': t.text.push_back('\\'); break;
+            case '"': t.text.push_back('"'); break;
+            case 'n': t.text.push_back('\n'); break;
+            case 'r': t.text.push_back('\r'); break;
+            case 't': t.text.push_back('\t'); break;
+            case '0': t.text.push_back('\0'); break;
+            case 'x': {
+                int hi = i + 1 < s.size() ? hex_digit(s[i + 1]) : -1;
+                int lo = i + 2 < s.size() ? hex_digit(s[i + 2]) : -1;
+                if (hi < 0 || lo < 0)
+                    fail(line, "bad \\x escape");
+                t.text.push_back(static_cast<char>(hi * 16 + lo));
+                i += 2;
+                break;
+            }
+            default:
+                fail(line, std::string("unknown escape \\") + s[i]);
+            }
+        }
+        ++i;
+        tokens.push_back(std::move(t));
+    }
+}
+
+} // namespace runtime_program_ns
+
+class runtime_program {
+public:
+    runtime_program() = default;
+    explicit runtime_program(std::vector<runtime_rule> rules) : rules_{std::move(rules)} {}
+
+    static runtime_program parse(std::string_view source) {
+        namespace h = runtime_program_ns;
+        std::vector<runtime_rule> rules;
+        size_t line = 0;
+        while (!source.empty()) {
+            ++line;
+            size_t eol = source.find('\n');
+            std::string_view s = source.substr(0, eol);
+            source.remove_prefix(eol == source.npos ? source.size() : eol + 1);
+
+            std::vector<h::token> tokens = h::tokenize(s, line);
+            if (tokens.empty())
+                continue;
+            size_t arrow = tokens.size();
+            for (size_t i = 0; i != tokens.size(); ++i) {
+                if (tokens[i].quoted || (tokens[i].text != "->" && tokens[i].text != "->."))
+                    continue;
+                if (arrow != tokens.size())
+                    h::fail(line, "more than one arrow");
+                arrow = i;
+            }
+            if (arrow == tokens.size())
+                h::fail(line, "no arrow (-> or ->.)");
+            if (arrow > 1 || tokens.size() - arrow > 2)
+                h::fail(line, "a side of a rule must be a single word or string");
+            runtime_rule r;
+            r.final = tokens[arrow].text == "->.";
+            if (arrow == 1)
+                r.search = std::move(tokens[0].text);
+            if (arrow + 2 == tokens.size())
+                r.replace = std::move(tokens[arrow + 1].text);
+            rules.push_back(std::move(r));
+        }
+        return runtime_program{std::move(rules)};
+    }
+
+    static runtime_program load(std::string const& path) {
+        mapped_file f{path};
+        try {
+            return parse(f.view());
+        } catch (std::invalid_argument const& e) {
+            throw std::invalid_argument(path + ": " + e.what());
+        }
+    }
+
+    std::vector<runtime_rule> const& rules() const { return rules_; }
+
+    // one step: the index of the applied rule, or npos if none matches
+    size_t step(std::string& text) const {
+        for (size_t i = 0; i != rules_.size(); ++i) {
+            runtime_rule const& r = rules_[i];
+            size_t pos = text.find(r.search);
+            if (pos == std::string::npos) {
+                NN_PROBE(rule_miss, r.search.c_str());
+                continue;
+            }
+            NN_PROBE(rule_match, r.search.c_str(), pos);
+            text.replace(pos, r.search.size(), r.replace);
+            NN_PROBE(substitute, r.search.c_str(), pos,
+                     static_cast<ptrdiff_t>(r.replace.size()) - static_cast<ptrdiff_t>(r.search.size()));
+            return i;
+        }
+        return std::string::npos;
+    }
+
+    machine_result run(std::string text, size_t limit = rule_loop_limit_v) const {
+        size_t steps = 0;
+        [[maybe_unused]] int kind = static_cast<int>(tristate_kind::not_matched_yet);
+        NN_PROBE(machine_start, text.size());
+        while (steps != limit) {
+            NN_PROBE(loop_iteration, steps, text.size());
+            size_t i = step(text);
+            if (i == std::string::npos) {
+                kind = static_cast<int>(tristate_kind::matched_final);
+                break;
+            }
+            ++steps;
+            if (rules_[i].final) {
+                kind = static_cast<int>(tristate_kind::matched_final);
+                break;
+            }
+        }
+        NN_PROBE(machine_end, text.size(), kind);
+        return {std::move(text), steps};
+    }
+
+private:
+    std::vector<runtime_rule> rules_;
+};
+
+} // namespace nn
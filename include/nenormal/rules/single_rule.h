@@ -3,6 +3,7 @@
 #include "rule_concepts.h"
 #include "../utility.h"
 #include "../substitute.h"
+#include "../usdt.h"
 
 #include <iostream>
 #include <iomanip>
@@ -71,10 +72,14 @@ template<Str auto s, Str auto r, rule_kind k> struct rule {
         }
     }
     constexpr tristate_kind update(RuleFixedInput auto& t) const {
-        if (!try_substitute_inplace(ct_search, ct_replace, inplace_extract_text(t))) {
+        size_t pos = try_substitute_inplace_at(ct_search, ct_replace, inplace_extract_text(t));
+        if (pos == std::string::npos) {
+            NN_PROBE(rule_miss, name.value);
             return tristate_kind::not_matched_yet;
         } else {
-            inplace_update_text(t, rule{});
+            NN_PROBE(rule_match, name.value, pos);
+            NN_PROBE(substitute, name.value, pos, static_cast<ptrdiff_t>(r.size()) - static_cast<ptrdiff_t>(s.size()));
+            inplace_update_text_edit(t, rule{}, pos, s.size(), r.view());
             if (k == rule_kind::regular) {
                 return tristate_kind::matched_regular;
             } else {
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "protocol.h"
+
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nn::service {
+
+// blocking client of unix_server.
+// call() is a round trip; send() and receive() allow to pipeline many requests over a connection
+// (responses may come in any order, match them by id).
+
+class unix_client {
+public:
+    explicit unix_client(std::string const& path) {
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "socket");
+        sockaddr_un addr = unix_address(path);
+        if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            int err = errno;
+            ::close(fd_);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+    }
+    ~unix_client() {
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+    unix_client(unix_client&& other) noexcept : fd_{std::exchange(other.fd_, -1)}, next_id_{other.next_id_} {}
+    unix_client& operator = (unix_client&&) = delete;
+
+    // sends the request, returns its id
+    uint64_t send(std::string_view program, std::string_view text) {
+        uint64_t id = next_id_++;
+        std::string out;
+        put_request(out, {'Q', id, std::string{program}, std::string{text}});
+        write_all(fd_, out);
+        return id;
+    }
+    // sends several requests at once (ids are consecutive, the first one is returned)
+    template<class Texts>
+    uint64_t send_all(std::string_view program, Texts const& texts) {
+        uint64_t first = next_id_;
+        std::string out;
+        for (auto const& text : texts)
+            put_request(out, {'Q', next_id_++, std::string{program}, std::string{text}});
+        write_all(fd_, out);
+        return first;
+    }
+
+    response receive() {
+        auto payload = read_frame(fd_);
+        if (!payload)
+            throw std::runtime_error("connection closed by the server");
+        return get_response(*payload);
+    }
+
+    response call(std::string_view program, std::string_view text) {
+        uint64_t id = send(program, text);
+        response r = receive();
+        if (r.id != id)
+            throw std::runtime_error("unexpected response (pipelined requests pending?)");
+        return r;
+    }
+
+    // statistics text of the server
+    std::string stats() {
+        uint64_t id = next_id_++;
+        std::string out;
+        put_request(out, {'S', id, {}, {}});
+        write_all(fd_, out);
+        return receive().text;
+    }
+
+private:
+    int fd_ = -1;
+    uint64_t next_id_ = 1;
+};
+
+} // namespace nn::service
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "../inplace/binary_io.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nn::service {
+
+// protocol of the execution service over a unix domain stream socket.
+// every message is a frame: 4 bytes of little-endian payload length, then the payload.
+// payloads are built of varints and length-prefixed bytes (see binary_io.h):
+//
+//   'Q' id:varint program:bytes text:bytes       - request: run the program over the text
+//   'S' id:varint                                - request: statistics of the server
+//   'A' id:varint status:byte steps:varint queue_us:varint text:bytes
+//                                                - response (text is the error message if status != ok)
+//
+// ids are chosen by the client; responses of a connection may come in any order.
+
+constexpr size_t max_frame = size_t{1} << 30;
+
+enum class status : unsigned char {
+    ok = 0,
+    unknown_program = 1,
+    error = 2,
+};
+
+struct request {
+    char kind = 'Q';
+    uint64_t id = 0;
+    std::string program;
+    std::string text;
+};
+
+struct response {
+    uint64_t id = 0;
+    service::status status = service::status::ok;
+    uint64_t steps = 0;
+    uint64_t queue_us = 0; // time in the queue of the server
+    std::string text;
+
+    bool operator == (response const&) const = default;
+};
+
+namespace protocol_ns {
+
+using namespace binary_io_ns;
+
+inline void begin_frame(std::string& out) { out.append(4, '\0'); }
+inline void end_frame(std::string& out, size_t start) {
+    uint32_t n = static_cast<uint32_t>(out.size() - start - 4);
+    for (int i = 0; i != 4; ++i)
+        out[start + i] = static_cast<char>((n >> (8 * i)) & 0xff);
+}
+
+} // namespace protocol_ns
+
+// appends the frame of the message to out
+inline void put_request(std::string& out, request const& r) {
+    namespace h = protocol_ns;
+    size_t start = out.size();
+    h::begin_frame(out);
+    out.push_back(r.kind);
+    h::put_varint(out, r.id);
+    if (r.kind == 'Q') {
+        h::put_bytes(out, r.program);
+        h::put_bytes(out, r.text);
+    }
+    h::end_frame(out, start);
+}
+inline void put_response(std::string& out, response const& r) {
+    namespace h = protocol_ns;
+    size_t start = out.size();
+    h::begin_frame(out);
+    out.push_back('A');
+    h::put_varint(out, r.id);
+    out.push_back(static_cast<char>(r.status));
+    h::put_varint(out, r.steps);
+    h::put_varint(out, r.queue_us);
+    h::put_bytes(out, r.text);
+    h::end_frame(out, start);
+}
+
+inline request get_request(std::string_view payload) {
+    protocol_ns::cursor c{payload};
+    request r;
+    r.kind = c.get();
+    if (r.kind != 'Q' && r.kind != 'S')
+        throw std::runtime_error("unknown request");
+    r.id = c.varint();
+    if (r.kind == 'Q') {
+        r.program = c.bytes();
+        r.text = c.bytes();
+    }
+    return r;
+}
+inline response get_response(std::string_view payload) {
+    protocol_ns::cursor c{payload};
+    if (c.get() != 'A')
+        throw std::runtime_error("unknown response");
+    response r;
+    r.id = c.varint();
+    r.status = static_cast<service::status>(c.get());
+    r.steps = c.varint();
+    r.queue_us = c.varint();
+    r.text = c.bytes();
+    return r;
+}
+
+// blocking io of whole buffers and frames; EINTR is retried
+
+inline void write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "send");
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+}
+
+// false on the end of the stream before the first byte
+inline bool read_all(int fd, char* data, size_t size) {
+    size_t done = 0;
+    while (done != size) {
+        ssize_t n = ::recv(fd, data + done, size - done, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "recv");
+        }
+        if (n == 0) {
+            if (done == 0)
+                return false;
+            throw std::runtime_error("truncated frame");
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// payload of the next frame, or nothing at the end of the stream
+inline std::optional<std::string> read_frame(int fd) {
+    unsigned char len[4];
+    if (!read_all(fd, reinterpret_cast<char*>(len), 4))
+        return {};
+    size_t n = size_t{len[0]} | size_t{len[1]} << 8 | size_t{len[2]} << 16 | size_t{len[3]} << 24;
+    if (n > max_frame)
+        throw std::runtime_error("frame too large");
+    std::string payload(n, '\0');
+    if (n != 0 && !read_all(fd, payload.data(), n))
+        throw std::runtime_error("truncated frame");
+    return payload;
+}
+
+inline sockaddr_un unix_address(std::string const& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("socket path is too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+} // namespace nn::service
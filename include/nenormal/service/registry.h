@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../rules.h"
+
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn::service {
+
+// registry of compiled programs which a process can run by name.
+// a program runs as MACHINE(p) with the loop limit Limit;
+// a fingerprinted program is also available as "#" + 16 hex digits of its fingerprint,
+// so clients may insist on the exact version of the program.
+// runs report to machine_metrics (if enabled), the program is labelled there by its name.
+
+class program_registry {
+public:
+    using runner = std::function<machine_result(std::string)>;
+
+    template<Rule auto p, size_t Limit = rule_loop_limit_v>
+    void add(std::string name) {
+        runner r = [](std::string text) {
+            machine_state<std::string> s = machine_fun_v<rule_loop_v<p, Limit>>(
+                machine_state<std::string>{std::move(text), 0, Limit}, std::stop_token{});
+            return machine_result{std::move(s.text), s.steps};
+        };
+        if (programs_.contains(name))
+            throw std::invalid_argument("program is already registered: " + name);
+        if constexpr (Fingerprinted<decltype(rule_loop_v<p, Limit>)>) {
+            constexpr uint64_t fingerprint = rule_fingerprint_v<rule_loop_v<p, Limit>>;
+            programs_.try_emplace(fingerprint_key(fingerprint), r); // same program under several names
+            machine_metrics::instance().name_program(fingerprint, name);
+        }
+        programs_.try_emplace(name, std::move(r));
+    }
+
+    // nullptr if there is no such program
+    runner const* find(std::string_view key) const {
+        auto it = programs_.find(key);
+        return it == programs_.end() ? nullptr : &it->second;
+    }
+
+    // names and fingerprint keys
+    std::vector<std::string> keys() const {
+        std::vector<std::string> v;
+        for (auto const& [k, r] : programs_)
+            v.push_back(k);
+        return v;
+    }
+
+    static std::string fingerprint_key(uint64_t fingerprint) {
+        return machine_metrics::fingerprint_key(fingerprint);
+    }
+
+private:
+    std::map<std::string, runner, std::less<>> programs_;
+};
+
+} // namespace nn::service
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "protocol.h"
+#include "registry.h"
+#include "../parallel/thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nn::service {
+
+// execution service over a unix domain socket (see protocol.h).
+// a reader thread per connection parses requests into a shared queue;
+// workers take requests from the queue in batches (up to max_batch, waiting at most batch_window
+// for a batch to fill), run them, and send the responses of a batch to each connection at once.
+// every response tells how long its request waited in the queue; the server keeps the statistics.
+
+struct server_options {
+    size_t workers = thread_pool::default_workers() + 1;
+    size_t max_batch = 64;
+    std::chrono::microseconds batch_window{100};
+};
+
+struct server_stats {
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    uint64_t queue_us_total = 0;
+    uint64_t queue_us_max = 0;
+    uint64_t queue_us_p50 = 0; // upper bounds (by powers of 2)
+    uint64_t queue_us_p99 = 0;
+
+    std::string str() const {
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+            "requests=%llu batches=%llu queue_us_mean=%llu queue_us_p50=%llu queue_us_p99=%llu queue_us_max=%llu",
+            static_cast<unsigned long long>(requests), static_cast<unsigned long long>(batches),
+            static_cast<unsigned long long>(requests ? queue_us_total / requests : 0),
+            static_cast<unsigned long long>(queue_us_p50), static_cast<unsigned long long>(queue_us_p99),
+            static_cast<unsigned long long>(queue_us_max));
+        return buf;
+    }
+};
+
+class unix_server {
+public:
+    using clock = std::chrono::steady_clock;
+
+    unix_server(std::string path, program_registry const& registry, server_options options = {})
+        : path_{std::move(path)}, registry_{registry}, options_{options}
+    {
+        if (options_.max_batch == 0)
+            options_.max_batch = 1;
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "socket");
+        sockaddr_un addr = unix_address(path_);
+        ::unlink(path_.c_str());
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, SOMAXCONN) != 0) {
+            int err = errno;
+            ::close(listen_fd_);
+            throw std::system_error(err, std::generic_category(), path_);
+        }
+        for (size_t i = 0; i != std::max<size_t>(options_.workers, 1); ++i)
+            workers_.emplace_back([this] { work(); });
+        acceptor_ = std::thread{[this] { accept_loop(); }};
+    }
+    ~unix_server() { stop(); }
+    unix_server(unix_server const&) = delete;
+    unix_server& operator = (unix_server const&) = delete;
+
+    std::string const& path() const { return path_; }
+
+    // stops accepting, drops the connections and the queue, waits for the threads
+    void stop() {
+        {
+            std::lock_guard lock{mutex_};
+            if (stopped_)
+                return;
+            stopped_ = true;
+        }
+        wake_.notify_all();
+        ::shutdown(listen_fd_, SHUT_RDWR);
+        acceptor_.join();
+        ::close(listen_fd_);
+        ::unlink(path_.c_str());
+        std::vector<std::thread> readers;
+        {
+            std::lock_guard lock{connections_mutex_};
+            for (auto& w : connections_)
+                if (auto c = w.lock())
+                    ::shutdown(c->fd, SHUT_RDWR);
+            readers.swap(readers_);
+        }
+        for (auto& t : readers)
+            t.join();
+        for (auto& t : workers_)
+            t.join();
+    }
+
+    server_stats stats() const {
+        std::lock_guard lock{stats_mutex_};
+        server_stats s = stats_;
+        s.queue_us_p50 = quantile(0.5);
+        s.queue_us_p99 = quantile(0.99);
+        return s;
+    }
+
+private:
+    struct connection {
+        int fd;
+        std::mutex write_mutex;
+
+        explicit connection(int fd) : fd{fd} {}
+        ~connection() { ::close(fd); }
+
+        void send(std::string_view data) {
+            std::lock_guard lock{write_mutex};
+            try {
+                write_all(fd, data);
+            } catch (std::system_error const&) {
+                // the client has gone; its reader will notice
+            }
+        }
+    };
+
+    struct job {
+        std::shared_ptr<connection> conn;
+        request req;
+        clock::time_point queued;
+    };
+
+    void accept_loop() {
+        while (true) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                return; // shut down
+            }
+            auto c = std::make_shared<connection>(fd);
+            std::lock_guard lock{connections_mutex_};
+            if (is_stopped()) {
+                ::shutdown(fd, SHUT_RDWR);
+                return;
+            }
+            std::erase_if(connections_, [](auto const& w) { return w.expired(); });
+            connections_.push_back(c);
+            readers_.emplace_back([this, c] { read_loop(c); });
+        }
+    }
+
+    void read_loop(std::shared_ptr<connection> c) {
+        try {
+            while (auto payload = read_frame(c->fd)) {
+                request r = get_request(*payload);
+                if (r.kind == 'S') {
+                    std::string out;
+                    put_response(out, {r.id, status::ok, 0, 0, stats().str()});
+                    c->send(out);
+                    continue;
+                }
+                {
+                    std::lock_guard lock{mutex_};
+                    queue_.push_back({c, std::move(r), clock::now()});
+                }
+                wake_.notify_one();
+            }
+        } catch (std::exception const&) {
+            // malformed stream or a dropped connection: close it
+        }
+        ::shutdown(c->fd, SHUT_RDWR);
+    }
+
+    bool is_stopped() {
+        std::lock_guard lock{mutex_};
+        return stopped_;
+    }
+
+    void work() {
+        std::vector<job> batch;
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock lock{mutex_};
+                wake_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+                if (stopped_)
+                    return;
+                if (queue_.size() < options_.max_batch && options_.batch_window.count() > 0)
+                    wake_.wait_for(lock, options_.batch_window,
+                                   [this] { return stopped_ || queue_.size() >= options_.max_batch; });
+                if (stopped_)
+                    return;
+                while (!queue_.empty() && batch.size() != options_.max_batch) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+            }
+            if (batch.empty())
+                continue;
+            run_batch(batch);
+        }
+    }
+
+    void run_batch(std::vector<job>& batch) {
+        std::map<connection*, std::string> out; // responses per connection
+        auto start = clock::now();
+        std::vector<uint64_t> waits;
+        waits.reserve(batch.size());
+        for (job& j : batch) {
+            uint64_t queue_us = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(start - j.queued).count());
+            waits.push_back(queue_us);
+            response r{j.req.id, status::ok, 0, queue_us, {}};
+            if (auto const* run = registry_.find(j.req.program)) {
+                try {
+                    machine_result res = (*run)(std::move(j.req.text));
+                    r.steps = res.steps;
+                    r.text = std::move(res.text);
+                } catch (std::exception const& e) {
+                    r.status = status::error;
+                    r.text = e.what();
+                }
+            } else {
+                r.status = status::unknown_program;
+                r.text = j.req.program;
+            }
+            put_response(out[j.conn.get()], r);
+        }
+        record(waits); // before the responses, so that a client sees its requests in the statistics
+        for (job& j : batch) {
+            auto it = out.find(j.conn.get());
+            if (it != out.end()) {
+                j.conn->send(it->second);
+                out.erase(it);
+            }
+        }
+    }
+
+    void record(std::vector<uint64_t> const& waits) {
+        std::lock_guard lock{stats_mutex_};
+        ++stats_.batches;
+        for (uint64_t w : waits) {
+            ++stats_.requests;
+            stats_.queue_us_total += w;
+            stats_.queue_us_max = std::max(stats_.queue_us_max, w);
+            size_t b = 0;
+            while ((uint64_t{1} << b) <= w && b + 1 != histogram_.size())
+                ++b;
+            ++histogram_[b];
+        }
+    }
+
+    // (stats_mutex_ is locked) upper bound of the bucket of the quantile
+    uint64_t quantile(double q) const {
+        uint64_t total = stats_.requests;
+        if (total == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b != histogram_.size(); ++b) {
+            seen += histogram_[b];
+            if (seen >= rank)
+                return b == 0 ? 0 : (uint64_t{1} << b) - 1;
+        }
+        return stats_.queue_us_max;
+    }
+
+    std::string path_;
+    program_registry const& registry_;
+    server_options options_;
+    int listen_fd_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<job> queue_;
+    bool stopped_ = false;
+
+    std::mutex connections_mutex_;
+    std::vector<std::weak_ptr<connection>> connections_;
+    std::vector<std::thread> readers_;
+
+    mutable std::mutex stats_mutex_;
+    server_stats stats_;
+    std::array<uint64_t, 40> histogram_{}; // bucket b: queue time in [2^(b-1), 2^b) us
+
+    std::vector<std::thread> workers_;
+    std::thread acceptor_;
+};
+
+} // namespace nn::service
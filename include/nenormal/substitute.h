@@ -46,30 +46,32 @@ constexpr MaybeCtStr auto try_substitute(CtStr auto cts, CtStr auto ctr, CtStr a
     }
 }
 
-constexpr bool try_substitute_inplace(CtStr auto cts, CtStr auto ctr, std::string& text) {
+// position of the substitution, or npos if there was none
+constexpr size_t try_substitute_inplace_at(CtStr auto cts, CtStr auto ctr, std::string& text) {
     constexpr Str auto const& s = cts.value;
     constexpr Str auto const& r = ctr.value;
 
     if (text.size() < s.size()) {
-        return false;
+        return std::string::npos;
     } else if (text == s.view()) {
         text = r.view();
-        return true;
+        return 0;
     } else if (s.empty() && r.empty()) {
-        return true;
+        return 0;
     } else {
         // size_t pos = text.find(s.view()); // not a constexpr!
         auto fbegin = std::search(text.begin(), text.end(), s.begin(), s.end());
         size_t pos = (fbegin == text.end()) ? std::string::npos : fbegin - text.begin();
-        if (pos == std::string::npos) {
-            return false;
-        } else {
+        if (pos != std::string::npos)
             text.replace(pos, s.size(), r.view());
-            return true;
-        }
+        return pos;
     }
 }
 
+constexpr bool try_substitute_inplace(CtStr auto cts, CtStr auto ctr, std::string& text) {
+    return try_substitute_inplace_at(cts, ctr, text) != std::string::npos;
+}
+
 using optional_string = std::optional<std::string>;
 
 optional_string try_substitute_opt(CtStr auto cts, CtStr auto ctr, std::string text) {
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <type_traits>
+
+// static tracepoints (USDT) of the rule engine, provider "nenormal",
+// for perf, bpftrace, systemtap etc:
+//
+//   bpftrace -e 'usdt:./prog:nenormal:rule_match { @[str(arg0)] = count(); }'
+//   perf probe -x ./prog sdt_nenormal:substitute
+//
+// they are compiled in with NENORMAL_USDT=1 (cmake option NENORMAL_USDT) on x86-64 and aarch64 elf,
+// otherwise NN_PROBE expands to nothing.
+// a compiled-in probe is a nop behind a check of its semaphore, which the tracer increments while attached:
+// when nobody listens, the arguments aren't even computed.
+//
+// probes (arguments):
+//   machine_start  (text size)
+//   machine_end    (text size, tristate_kind: 0 - the limit is reached or the run is interrupted, 2 - final)
+//   loop_iteration (number of the iteration from 0, text size)
+//   rule_match     (rule name, position)
+//   rule_miss      (rule name)
+//   substitute     (rule name, position, size delta)
+// rule names are nul-terminated static strings, as rules are printed (for runtime programs, the search string).
+// a marker walk of flat loops (several steps at once) fires a single match and substitution.
+//
+// the probe notes have the format of <sys/sdt.h> (".note.stapsdt", version 3), written by hand
+// to not depend on systemtap headers.
+
+#if defined(NENORMAL_USDT) && NENORMAL_USDT && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define NN_USDT_ENABLED 1
+#else
+#define NN_USDT_ENABLED 0
+#endif
+
+#if NN_USDT_ENABLED
+
+// semaphores: weak, so that every translation unit may define them
+#define NN_USDT_SEMAPHORE(name) \
+    extern "C" { \
+        __attribute__((weak, used, section(".probes"), visibility("hidden"))) \
+        volatile unsigned short nenormal_##name##_semaphore = 0; \
+    }
+
+NN_USDT_SEMAPHORE(machine_start)
+NN_USDT_SEMAPHORE(machine_end)
+NN_USDT_SEMAPHORE(loop_iteration)
+NN_USDT_SEMAPHORE(rule_match)
+NN_USDT_SEMAPHORE(rule_miss)
+NN_USDT_SEMAPHORE(substitute)
+
+#define NN_USDT_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte nenormal_" #name "_semaphore\n" \
+    ".asciz \"nenormal\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+// argument i (arrays decay to pointers): its size (negative if signed, "%n" negates it back) and its location
+#define NN_USDT_TYPE(x) ::std::decay_t<decltype((x))>
+#define NN_USDT_ARG(i, x) \
+    [s##i] "n" ((::std::is_signed_v<NN_USDT_TYPE(x)> ? 1 : -1) * static_cast<int>(sizeof(NN_USDT_TYPE(x)))), \
+    [a##i] "nor" (static_cast<NN_USDT_TYPE(x)>(x))
+
+#define NN_USDT_PROBE(name, args, ...) \
+    do { \
+        if !consteval { \
+            if (nenormal_##name##_semaphore) \
+                __asm__ __volatile__ (NN_USDT_NOTE(name, args) :: __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define NN_PROBE1(name, x0) \
+    NN_USDT_PROBE(name, "%n[s0]@%[a0]", NN_USDT_ARG(0, x0))
+#define NN_PROBE2(name, x0, x1) \
+    NN_USDT_PROBE(name, "%n[s0]@%[a0] %n[s1]@%[a1]", NN_USDT_ARG(0, x0), NN_USDT_ARG(1, x1))
+#define NN_PROBE3(name, x0, x1, x2) \
+    NN_USDT_PROBE(name, "%n[s0]@%[a0] %n[s1]@%[a1] %n[s2]@%[a2]", NN_USDT_ARG(0, x0), NN_USDT_ARG(1, x1), NN_USDT_ARG(2, x2))
+
+#define NN_PROBE_PICK(_0, _1, _2, _3, m, ...) m
+// NN_PROBE(name, args...), 1 to 3 arguments
+#define NN_PROBE(...) NN_PROBE_PICK(__VA_ARGS__, NN_PROBE3, NN_PROBE2, NN_PROBE1, _)(__VA_ARGS__)
+
+// whether a tracer listens to the probe
+#define NN_PROBE_ENABLED(name) (nenormal_##name##_semaphore != 0)
+
+#else
+
+#define NN_PROBE(...) do {} while (0)
+#define NN_PROBE_ENABLED(name) false
+
+#endif
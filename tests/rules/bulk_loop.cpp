@@ -0,0 +1,134 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <random>
+
+namespace nn { namespace {
+
+template<Rule auto p> constexpr size_t group_size_v = bulk_loop_helpers_ns::bulk_group_size<flat_leaves_t<decltype(p)>>;
+
+constexpr auto reduce_pairs = RULES(
+    RULE("()", ""),
+    RULE("[]", ""),
+    RULE("{}", "")
+);
+
+constexpr auto brackets = RULES(
+    reduce_pairs,
+    RULE("(", "_"),
+    RULE("[", "_"),
+    RULE("{", "_"),
+    RULE(")", "_"),
+    RULE("]", "_"),
+    RULE("}", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "ERROR"),
+    FINAL_RULE("", "OK")
+);
+
+TEST(bulk_loop, confluence) {
+    static_assert(group_size_v<reduce_pairs> == 3);
+    static_assert(group_size_v<brackets> == 3);            // "(" -> "_" does not shorten
+    static_assert(group_size_v<RULE("__", "_")> == 1);     // "___" is joinable
+    static_assert(group_size_v<RULE("ab", "")> == 1);
+    static_assert(group_size_v<RULES(RULE("ab", "x"), RULE("bc", "y"))> == 1); // "abc" -> "xc" or "ay"
+    static_assert(group_size_v<RULES(RULE("ab", "x"), RULE("b", ""))> == 1);   // "ab" -> "x" or "a"
+    static_assert(group_size_v<RULES(RULE("aa", ""), RULE("b", ""))> == 1);    // different step counts
+    static_assert(group_size_v<RULES(RULE("a", "b"), RULE("aa", ""))> == 0);   // not shortening
+    static_assert(group_size_v<RULES(RULE("abc", "x"), RULE("ab", ""))> == 1); // "abc" -> "x" or "c"
+    static_assert(group_size_v<FINAL_RULE("ab", "")> == 0);
+}
+
+// reference run: one p.update per step
+size_t reference_run(Rule auto p, std::string& t, size_t limit = rule_loop_limit_v) {
+    size_t steps = 0;
+    while (steps < limit) {
+        tristate_kind k = p.update(t);
+        if (k == tristate_kind::not_matched_yet)
+            break;
+        ++steps;
+        if (k == tristate_kind::matched_final)
+            break;
+    }
+    return steps;
+}
+
+struct bulk_counter {
+    size_t steps = 0;
+    size_t calls = 0;
+    constexpr bool operator == (bulk_counter const&) const = default;
+};
+constexpr auto count_steps = [](bulk_counter c, auto p, std::string const& t) {
+    return bulk_counter{c.steps + 1, c.calls + 1};
+};
+constexpr auto count_bulk = [](bulk_counter c, auto p, std::string const& t, size_t n) {
+    return bulk_counter{c.steps + n, c.calls + 1};
+};
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v, size_t Threshold = parallel_rule_threshold_v>
+void expect_same_run(std::string src) {
+    std::string ref = src;
+    size_t ref_steps = reference_run(p, ref, Limit);
+
+    constexpr auto m = MACHINE_FROM_RULE((bulk_loop<p, Limit, Threshold>{}));
+    EXPECT_EQ(m(src), ref) << src;
+
+    auto counted = m(inplace_augmented_text{src, inplace_bulk_effect{bulk_counter{}, count_bulk}});
+    EXPECT_EQ(counted.text, ref) << src;
+    EXPECT_EQ(counted.aux.a.steps, ref_steps) << src;
+
+    // step by step augmentation: no bulk passes
+    auto stepwise = m(inplace_augmented_text{src, inplace_cumulative_effect{bulk_counter{}, count_steps}});
+    EXPECT_EQ(stepwise.text, ref) << src;
+    EXPECT_EQ(stepwise.aux.a.steps, ref_steps) << src;
+}
+
+TEST(bulk_loop, brackets) {
+    expect_same_run<brackets, rule_loop_unlimited_v>("");
+    expect_same_run<brackets, rule_loop_unlimited_v>("([]{()})");
+    expect_same_run<brackets, rule_loop_unlimited_v>("([)]");
+    expect_same_run<brackets, rule_loop_unlimited_v>("(()[]");
+    std::mt19937 gen{3};
+    for (size_t i = 0; i != 20; ++i) {
+        std::string src;
+        for (size_t j = gen() % 200; j != 0; --j)
+            src += "()[]{}"[gen() % 6];
+        expect_same_run<brackets, rule_loop_unlimited_v>(src);
+    }
+}
+
+TEST(bulk_loop, limited) {
+    // the pass would exceed the limit, so the rest is done step by step
+    for (size_t n : {0, 1, 2, 5, 9, 10})
+        expect_same_run<brackets, 5>(std::string(n, '(') + std::string(n, ')'));
+    expect_same_run<RULE("__", "_"), 7>(std::string(20, '_'));
+}
+
+TEST(bulk_loop, deep_nesting) {
+    constexpr auto m = BULK_MACHINE(brackets);
+    constexpr auto unlimited = MACHINE_FROM_RULE((bulk_loop<brackets, rule_loop_unlimited_v>{}));
+    EXPECT_EQ(m("(" + std::string(100, '[') + std::string(100, ']') + ")"), "OK");
+    size_t n = 100000;
+    EXPECT_EQ(unlimited(std::string(n, '(') + std::string(n, ')')), "OK");
+    EXPECT_EQ(unlimited(std::string(300, '(') + std::string(300, ']')), "ERROR");
+}
+
+TEST(bulk_loop, segments) {
+    // small threshold: every pass is done by segments and seams
+    std::mt19937 gen{5};
+    for (size_t i = 0; i != 5; ++i) {
+        std::string src;
+        for (size_t j = 300 + gen() % 300; j != 0; --j)
+            src += "(())[]{}"[gen() % 8];
+        expect_same_run<brackets, rule_loop_unlimited_v, 64>(src);
+        expect_same_run<brackets, 100, 64>(src);
+    }
+    expect_same_run<brackets, rule_loop_unlimited_v, 64>(std::string(500, '(') + std::string(500, ')'));
+    expect_same_run<RULE("__", "_"), rule_loop_unlimited_v, 64>(std::string(1000, '_'));
+}
+
+TEST(bulk_loop, fingerprint) {
+    static_assert(rule_fingerprint_v<bulk_loop_v<brackets>> == rule_fingerprint_v<rule_loop_v<brackets>>);
+}
+
+} } // namespace nn
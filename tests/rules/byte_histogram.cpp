@@ -0,0 +1,47 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+
+namespace nn { namespace {
+
+TEST(byte_histogram, requirement) {
+    constexpr auto req = byte_requirement_v<STR("11111o")>;
+    static_assert(req.size == 2);
+    static_assert(req.counts[0].byte == '1' && req.counts[0].count == 5);
+    static_assert(req.counts[1].byte == 'o' && req.counts[1].count == 1);
+    static_assert(byte_requirement_v<STR("")>.size == 0);
+}
+
+TEST(byte_histogram, admits) {
+    byte_histogram h{"1111o1"};
+    EXPECT_TRUE(h.admits(byte_requirement_v<STR("11111o")>));
+    EXPECT_TRUE(h.admits(byte_requirement_v<STR("")>));
+    EXPECT_FALSE(h.admits(byte_requirement_v<STR("oo")>));
+    EXPECT_FALSE(h.admits(byte_requirement_v<STR("[d]")>));
+    h.substitute("o", "oo");
+    EXPECT_TRUE(h.admits(byte_requirement_v<STR("oo")>));
+    h.substitute("11", "");
+    EXPECT_EQ(h['1'], 3);
+    EXPECT_FALSE(h.admits(byte_requirement_v<STR("11111o")>));
+}
+
+// the prefilter must not change the result of a program
+constexpr auto digits = RULES(
+    RULE("[0]", "0"),
+    RULE("[1]", "1"),
+    RULE("11111o", "o1"),
+    RULE("1o", "o"),
+    RULE("o", ""),
+    RULE("x", "[1][0]")
+);
+
+TEST(byte_histogram, program) {
+    constexpr auto m = MACHINE(digits);
+    for (std::string src : {"", "[0]", "xo", "x11111111111o", "1111o[1]", "[1]11111o11111o"}) {
+        std::string ref = src;
+        while (digits.update(ref) == tristate_kind::matched_regular) {}
+        EXPECT_EQ(m(src), ref) << src;
+    }
+}
+
+} } // namespace nn
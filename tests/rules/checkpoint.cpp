@@ -0,0 +1,101 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <filesystem>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FINAL_RULE("<1>", "")
+);
+
+struct crash {};
+size_t crash_at = 0; // step to crash at (0 - never)
+
+struct counter {
+    size_t steps = 0;
+    size_t length = 0; // sum of lengths of texts
+    constexpr bool operator == (counter const&) const = default;
+};
+constexpr auto count = [](counter c, auto p, std::string const& t) {
+    if (crash_at != 0 && c.steps + 1 == crash_at)
+        throw crash{};
+    return counter{c.steps + 1, c.length + t.size()};
+};
+
+struct checkpoint_files {
+    std::string path = (std::filesystem::temp_directory_path() / "nenormal_checkpoint").string();
+    checkpoint_files() { clean(); }
+    ~checkpoint_files() { clean(); }
+    void clean() {
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + ".delta");
+        std::filesystem::remove(path + ".tmp");
+    }
+};
+
+TEST(checkpoint, same_as_machine) {
+    checkpoint_files files;
+    std::string src = "<" + std::string(27, '1') + ">";
+    auto expected = MACHINE(collatz)(inplace_augmented_text{src, inplace_cumulative_effect{counter{}, count}});
+
+    checkpointed_machine<collatz> m{{files.path, 10}};
+    auto actual = m(inplace_augmented_text{src, inplace_cumulative_effect{counter{}, count}});
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(m(src), MACHINE(collatz)(src));
+
+    // the last checkpoint is the final state
+    auto s = load_checkpoint(files.path, std::string{});
+    EXPECT_TRUE(s.finished);
+    EXPECT_EQ(s.text, expected.text);
+    EXPECT_EQ(s.steps, expected.aux.a.steps);
+}
+
+TEST(checkpoint, resume_after_crash) {
+    checkpoint_files files;
+    std::string src = "<" + std::string(27, '1') + ">";
+    auto expected = MACHINE(collatz)(inplace_augmented_text{src, inplace_cumulative_effect{counter{}, count}});
+    ASSERT_GT(expected.aux.a.steps, 1000);
+
+    for (size_t full_every : {1, 4, 1000}) {
+        checkpointed_machine<collatz> m{{files.path, 7, {}, full_every}};
+        crash_at = 1000;
+        EXPECT_THROW(m(inplace_augmented_text{src, inplace_cumulative_effect{counter{}, count}}), crash);
+        EXPECT_EQ(std::filesystem::exists(files.path + ".delta"), full_every > 1);
+
+        auto s = load_checkpoint(files.path, inplace_augmented_text{std::string{}, inplace_cumulative_effect{counter{}, count}});
+        EXPECT_FALSE(s.finished);
+        EXPECT_EQ(s.steps, 994); // the last multiple of 7 before the crash
+        EXPECT_EQ(s.text.aux.a.steps, s.steps);
+        EXPECT_EQ(s.budget, rule_loop_limit_v - s.steps);
+
+        crash_at = 0;
+        auto actual = m.resume(inplace_augmented_text{std::string{}, inplace_cumulative_effect{counter{}, count}});
+        EXPECT_EQ(actual, expected);
+        files.clean();
+    }
+}
+
+TEST(checkpoint, budget) {
+    checkpoint_files files;
+    std::string src = "<" + std::string(27, '1') + ">";
+    checkpointed_machine<collatz, 100> m{{files.path, 30}};
+    EXPECT_EQ(m(src), (MACHINE_FROM_RULE((rule_loop<collatz, 100>{})))(src));
+    auto s = load_checkpoint(files.path, std::string{});
+    EXPECT_EQ(s.steps, 100);
+    EXPECT_EQ(s.budget, 0);
+}
+
+TEST(checkpoint, missing) {
+    EXPECT_THROW(load_checkpoint("/nonexistent/nenormal_checkpoint", std::string{}), std::system_error);
+}
+
+} } // namespace nn
@@ -0,0 +1,32 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+
+namespace nn { namespace {
+
+constexpr auto a_b = RULE("a", "b");
+constexpr auto c_d = RULE("c", "d");
+constexpr auto p = RULES(a_b, c_d);
+constexpr auto named_p = NAMED_RULE(named_p, p);
+
+TEST(fingerprint, single_rules) {
+    static_assert(rule_fingerprint_v<a_b> == rule_fingerprint_v<RULE("a", "b")>);
+    static_assert(rule_fingerprint_v<a_b> != rule_fingerprint_v<RULE("a", "c")>);
+    static_assert(rule_fingerprint_v<a_b> != rule_fingerprint_v<RULE("c", "b")>);
+    static_assert(rule_fingerprint_v<a_b> != rule_fingerprint_v<FINAL_RULE("a", "b")>);
+    // strings are length-prefixed
+    static_assert(rule_fingerprint_v<RULE("ab", "c")> != rule_fingerprint_v<RULE("a", "bc")>);
+}
+
+TEST(fingerprint, structure) {
+    static_assert(rule_fingerprint_v<p> != rule_fingerprint_v<RULES(c_d, a_b)>);
+    static_assert(rule_fingerprint_v<p> != rule_fingerprint_v<HIDDEN_RULE(p)>);
+    static_assert(rule_fingerprint_v<FACADE_RULE("x", p)> != rule_fingerprint_v<FACADE_RULE("y", p)>);
+    static_assert(rule_fingerprint_v<RULE_LOOP(p)> != rule_fingerprint_v<(rule_loop_v<p, 10>)>);
+    static_assert(rule_fingerprint_v<EMPTY()> != rule_fingerprint_v<RULES(EMPTY())>);
+    // transparent wrappers
+    static_assert(rule_fingerprint_v<named_p> == rule_fingerprint_v<p>);
+    static_assert(rule_fingerprint_v<PARALLEL_RULE(p)> == rule_fingerprint_v<p>);
+}
+
+} } // namespace nn
@@ -0,0 +1,115 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+
+namespace nn { namespace {
+
+template<Str auto s, Str auto r>
+void expect_same_substitution(fingerprinted_text& t, std::string& expected) {
+    bool expected_ok = try_substitute_inplace(ct<s>{}, ct<r>{}, expected);
+    bool ok = try_substitute_inplace(ct<s>{}, ct<r>{}, t);
+    EXPECT_EQ(ok, expected_ok) << expected;
+    EXPECT_EQ(t.str(), expected);
+    EXPECT_EQ(t.fingerprint(), fingerprinted_text::fingerprint_of(expected));
+}
+
+TEST(fingerprinted_text, substitute) {
+    fingerprinted_text t{std::string("abcabc")};
+    std::string expected = "abcabc";
+    EXPECT_EQ(t.fingerprint(), fingerprinted_text::fingerprint_of(expected));
+    expect_same_substitution<STR("b"), STR("xyz")>(t, expected);
+    expect_same_substitution<STR("zca"), STR("")>(t, expected);
+    expect_same_substitution<STR("axybc"), STR("")>(t, expected); // whole text
+    EXPECT_EQ(t.chunks(), 0);
+    expect_same_substitution<STR(""), STR("!")>(t, expected);     // empty text
+    expect_same_substitution<STR("?"), STR("")>(t, expected);
+    EXPECT_NE(fingerprinted_text::fingerprint_of("ab"), fingerprinted_text::fingerprint_of("ba"));
+    EXPECT_NE(fingerprinted_text::fingerprint_of(""), fingerprinted_text::fingerprint_of(std::string(1, '\0')));
+}
+
+TEST(fingerprinted_text, random_edits) {
+    std::mt19937 gen{42};
+    std::string expected(2000, ' ');
+    for (char& c : expected)
+        c = "ab"[gen() % 2];
+    fingerprinted_text t{expected};
+    for (size_t i = 0; i != 1500; ++i) {
+        switch (gen() % 5) {
+        case 0: expect_same_substitution<STR("ab"), STR("ba")>(t, expected); break;
+        case 1: expect_same_substitution<STR("aab"), STR("b")>(t, expected); break;
+        case 2: expect_same_substitution<STR("bbb"), STR("abbba")>(t, expected); break;
+        case 3: expect_same_substitution<STR("ba"), STR("")>(t, expected); break;
+        case 4: expect_same_substitution<STR("a"), STR("bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb")>(t, expected); break;
+        }
+    }
+    // chunks do not fragment
+    EXPECT_LE(t.chunks(), expected.size() / fingerprinted_text::min_chunk + 2);
+}
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE")
+);
+
+TEST(fingerprinted_text, machine) {
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<brackets, rule_loop_unlimited_v>{}));
+    for (std::string src : {std::string(""), std::string("(()())"), std::string(300, '(') + std::string(300, ')') + "("}) {
+        fingerprinted_text t = m(fingerprinted_text{src});
+        EXPECT_EQ(t.str(), m(src));
+        EXPECT_EQ(t.fingerprint(), fingerprinted_text::fingerprint_of(m(src)));
+    }
+}
+
+// microbenchmark: collisions among many random short texts (expected ~ k^2 * n / 2^62, i.e. none),
+// and the cost of maintaining the fingerprint against rehashing after every step
+TEST(fingerprinted_text, benchmark) {
+    std::mt19937_64 gen{1};
+    std::unordered_set<uint64_t> seen;
+    std::unordered_set<std::string> texts;
+    size_t collisions = 0;
+    for (size_t i = 0; i != 200000; ++i) {
+        std::string s(gen() % 16 + 1, ' ');
+        for (char& c : s)
+            c = "ab"[gen() % 2];
+        if (texts.insert(s).second && !seen.insert(fingerprinted_text::fingerprint_of(s)).second)
+            ++collisions;
+    }
+    std::cout << texts.size() << " distinct texts, " << collisions << " collisions" << std::endl;
+    EXPECT_EQ(collisions, 0);
+
+    using clock = std::chrono::steady_clock;
+    std::string src = std::string(1 << 15, 'b') + "a"; // every step moves 'a' by one
+    size_t steps = 1000;
+
+    fingerprinted_text t{src};
+    auto start = clock::now();
+    uint64_t h1 = 0;
+    for (size_t i = 0; i != steps; ++i) {
+        try_substitute_inplace(ct<STR("ab")>{}, ct<STR("ba")>{}, t);
+        h1 ^= t.fingerprint();
+    }
+    auto incremental = clock::now() - start;
+
+    std::string s = src;
+    start = clock::now();
+    uint64_t h2 = 0;
+    for (size_t i = 0; i != steps; ++i) {
+        try_substitute_inplace(ct<STR("ab")>{}, ct<STR("ba")>{}, s);
+        h2 ^= fingerprinted_text::fingerprint_of(s);
+    }
+    auto rehash = clock::now() - start;
+
+    EXPECT_EQ(h1, h2);
+    auto us = [](auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+    std::cout << steps << " steps over " << src.size() << " chars: incremental " << us(incremental)
+              << " us, rehashing " << us(rehash) << " us" << std::endl;
+}
+
+} } // namespace nn
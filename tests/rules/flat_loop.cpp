@@ -0,0 +1,129 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+
+namespace nn { namespace {
+
+// reference run: one p.update per step, exactly as rule_loop does for non-flattenable rules
+size_t reference_run(Rule auto p, std::string& t, size_t limit = rule_loop_limit_v) {
+    size_t steps = 0;
+    while (steps < limit) {
+        tristate_kind k = p.update(t);
+        if (k == tristate_kind::not_matched_yet)
+            break;
+        ++steps;
+        if (k == tristate_kind::matched_final)
+            break;
+    }
+    return steps;
+}
+
+struct bulk_counter {
+    size_t steps = 0;
+    size_t calls = 0;
+    constexpr bool operator == (bulk_counter const&) const = default;
+};
+constexpr auto count_bulk = [](bulk_counter c, auto p, std::string const& t, size_t n) {
+    return bulk_counter{c.steps + n, c.calls + 1};
+};
+
+template<Rule auto p, size_t Limit = rule_loop_limit_v>
+void expect_same_run(std::string src, size_t expected_calls) {
+    std::string ref = src;
+    size_t ref_steps = reference_run(p, ref, Limit);
+
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<p, Limit>{}));
+    EXPECT_EQ(m(src), ref) << src;
+
+    auto counted = m(inplace_augmented_text{src, inplace_bulk_effect{bulk_counter{}, count_bulk}});
+    EXPECT_EQ(counted.text, ref) << src;
+    EXPECT_EQ(counted.aux.a.steps, ref_steps) << src;
+    EXPECT_EQ(counted.aux.a.calls, expected_calls) << src;
+}
+
+constexpr auto collatz_count = RULES(
+    RULE("<1111111111", "<:1111111111c"),
+    RULE("c1111111111", "1111111111c"),
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c")
+);
+
+TEST(flat_loop, single_walk) {
+    // c walks over the whole run at once
+    expect_same_run<RULE("c1", "1c")>("c", 0);
+    expect_same_run<RULE("c1", "1c")>("c1", 1);
+    expect_same_run<RULE("c1", "1c")>("c11111", 1);
+    expect_same_run<RULE("c1", "1c")>("00c1111100", 1);
+    expect_same_run<RULE("[x]12", "12[x]")>("[x]12121212121", 1);
+    // periodic marker and run
+    expect_same_run<RULE("aab", "aba")>("aabababab", 1);
+}
+
+TEST(flat_loop, walk_of_walks) {
+    // 10-step walk goes first, then 2-step walk finishes the run
+    expect_same_run<collatz_count>("<1111111111111111111111111>", 3);
+    expect_same_run<collatz_count>("<11111>", 2);
+    expect_same_run<collatz_count>(std::string("<") + std::string(1000, '1') + ">", 2);
+    expect_same_run<collatz_count>(std::string("<") + std::string(1005, '1') + ">", 3);
+}
+
+TEST(flat_loop, interference) {
+    // rule of higher priority matches in the middle of the walk
+    expect_same_run<RULES(RULE("111c1", "z"), RULE("c1", "1c"))>("c1111", 2);
+    expect_same_run<RULES(RULE("1c1", "z"), RULE("c1", "1c"))>("c1111", 2);
+    // marker stops at another marker, then they leapfrog each other
+    expect_same_run<RULE("[m]1", "1[m]")>("[m]11[m]11", 5);
+    // marker makes way for another marker which becomes leftmost
+    expect_same_run<RULE("c11", "11c")>("c11c1111c11", 8);
+    // rule of lower priority does not interfere
+    expect_same_run<RULES(RULE("c1", "1c"), RULE("1", "0"))>("c1111", 5);
+}
+
+TEST(flat_loop, limited) {
+    for (size_t n : {0, 1, 2, 5, 10}) {
+        std::string src = "c" + std::string(n, '1');
+        expect_same_run<RULE("c1", "1c"), 3>(src, n ? 1 : 0);
+        expect_same_run<RULE("c1", "1c"), 0>(src, 0);
+    }
+}
+
+TEST(flat_loop, step_by_step_augmentation) {
+    // augmentation which does not accept bulk steps sees every step
+    constexpr auto m = MACHINE(collatz_count);
+    std::string src = "<" + std::string(25, '1') + ">";
+    std::vector<std::string> trace;
+    auto dst = m(inplace_augmented_text{src, inplace_side_effect{
+        [&](auto p, std::string const& t) { trace.push_back(t); }
+    }});
+    std::string ref = src;
+    EXPECT_EQ(reference_run(collatz_count, ref), trace.size());
+    EXPECT_EQ(dst.text, ref);
+    EXPECT_EQ(trace.back(), ref);
+    EXPECT_EQ(trace[1], "<:1111111111" "1111111111c" "11111>");
+}
+
+TEST(flat_loop, hidden_walk) {
+    // hidden walk is done at once regardless of augmentation
+    constexpr auto p = RULES(HIDDEN_RULE(RULE("c1", "1c")), RULE("c", "d"));
+    constexpr auto m = MACHINE(p);
+    size_t calls = 0;
+    auto dst = m(inplace_augmented_text{std::string("c1111"), inplace_side_effect{
+        [&](auto p, std::string const& t) { ++calls; }
+    }});
+    EXPECT_EQ(dst.text, "1111d");
+    EXPECT_EQ(calls, 1);
+}
+
+TEST(flat_loop, long_walk) {
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<collatz_count, rule_loop_unlimited_v>{}));
+    const size_t n = 1'000'000;
+    auto dst = m(inplace_augmented_text{
+        "<" + std::string(n, '1') + ">",
+        inplace_bulk_effect{bulk_counter{}, count_bulk}
+    });
+    EXPECT_EQ(dst.text, "<:" + std::string(n, '1') + "c>");
+    EXPECT_EQ(dst.aux.a.steps, n / 10);
+    EXPECT_EQ(dst.aux.a.calls, 2);
+}
+
+} } // namespace nn
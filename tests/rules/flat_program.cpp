@@ -0,0 +1,83 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <tuple>
+
+namespace nn { namespace {
+
+constexpr auto a_b = RULE("a", "b");
+constexpr auto c_d = FINAL_RULE("c", "d");
+constexpr auto walk = RULE("[x]1", "1[x]");
+
+constexpr auto program = RULES(
+    a_b,
+    HIDDEN_RULE(RULES(c_d, FACADE_RULE("f", walk))),
+    FACADE_RULE("g", RULES(a_b, HIDDEN_RULE(c_d), FACADE_RULE("h", walk))),
+    NAMED_RULE(named, RULES(walk, EMPTY(), RULES()))
+);
+
+template<size_t I> using leaf_at = std::tuple_element_t<I, decltype(
+    []<class... Ls>(leaf_list<Ls...>) { return std::tuple<Ls...>{}; }(flat_leaves_t<decltype(program)>{})
+)>;
+
+constexpr auto named_a_b = NAMED_RULE(named_a_b, a_b);
+
+TEST(flat_program, flattenable) {
+    static_assert(Flattenable<decltype(a_b)>);
+    static_assert(Flattenable<decltype(EMPTY())>);
+    static_assert(Flattenable<decltype(RULES())>);
+    static_assert(Flattenable<decltype(RULES(a_b, c_d))>);
+    static_assert(Flattenable<decltype(HIDDEN_RULE(a_b))>);
+    static_assert(Flattenable<decltype(FACADE_RULE("f", a_b))>);
+    static_assert(Flattenable<decltype(named_a_b)>);
+    // loops cannot be flattened, nor the rules that contain them
+    static_assert(!Flattenable<decltype(RULE_LOOP(a_b))>);
+    static_assert(!Flattenable<decltype(RULES(a_b, RULE_LOOP(c_d)))>);
+    static_assert(!Flattenable<decltype(FACADE_RULE("f", RULE_LOOP(c_d)))>);
+}
+
+TEST(flat_program, leaves) {
+    STATIC_ASSERT_EQ(flat_leaves_t<decltype(EMPTY())>::size, 0);
+    STATIC_ASSERT_EQ(flat_leaves_t<decltype(RULES(a_b, RULES(), c_d, a_b))>::size, 3);
+
+    // the leaves are in the order of priority
+    STATIC_ASSERT_EQ(leaf_at<0>::search, STR("a"));
+    STATIC_ASSERT_EQ(leaf_at<1>::search, STR("c"));
+    STATIC_ASSERT_EQ(leaf_at<1>::kind, rule_kind::final);
+    STATIC_ASSERT_EQ(leaf_at<2>::search, STR("[x]1"));
+    STATIC_ASSERT_EQ(leaf_at<6>::replace, STR("1[x]"));
+}
+
+TEST(flat_program, reporters) {
+    // the rule itself
+    STATIC_ASSERT_EQ_TYPE(leaf_at<0>::reporter_type, std::remove_cvref_t<decltype(a_b)>);
+    STATIC_ASSERT_EQ_TYPE(leaf_at<6>::reporter_type, std::remove_cvref_t<decltype(walk)>);
+    // hidden rule hides everything inside, even facades
+    static_assert(leaf_at<1>::hidden);
+    static_assert(leaf_at<2>::hidden);
+    // outermost facade reports for everything inside, except for hidden rules
+    STATIC_ASSERT_EQ(leaf_at<3>::reporter.name, STR("g"));
+    static_assert(leaf_at<4>::hidden);
+    STATIC_ASSERT_EQ(leaf_at<5>::reporter.name, STR("g"));
+}
+
+TEST(flat_program, walks) {
+    using leaf = decltype([]<class L>(leaf_list<L>) { return L{}; }(flat_leaves_t<decltype(walk)>{}));
+    static_assert(leaf::is_walk);
+    STATIC_ASSERT_EQ(leaf::walk_marker, 3);
+    STATIC_ASSERT_EQ(leaf::walk_step, 1);
+
+    constexpr auto walk_of = [](Rule auto p) {
+        using L = decltype([]<class L>(leaf_list<L>) { return L{}; }(flat_leaves_t<decltype(p)>{}));
+        return std::pair{L::walk_marker, L::walk_step};
+    };
+    STATIC_ASSERT_EQ(walk_of(RULE("c11", "11c")), (std::pair<size_t, size_t>{1, 2}));
+    STATIC_ASSERT_EQ(walk_of(RULE("c1111111111", "1111111111c")), (std::pair<size_t, size_t>{1, 10}));
+    STATIC_ASSERT_EQ(walk_of(RULE("aab", "aba")), (std::pair<size_t, size_t>{1, 2}));
+    // not walks
+    STATIC_ASSERT_EQ(walk_of(RULE("11e", "e1")), (std::pair<size_t, size_t>{0, 0}));
+    STATIC_ASSERT_EQ(walk_of(RULE("ab", "bb")), (std::pair<size_t, size_t>{0, 0}));
+    STATIC_ASSERT_EQ(walk_of(FINAL_RULE("ab", "ba")), (std::pair<size_t, size_t>{0, 0}));
+}
+
+} } // namespace nn
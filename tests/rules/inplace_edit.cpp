@@ -0,0 +1,137 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+
+// applies the edits to its own copy of the text and checks it against the text
+struct replica {
+    std::string copy;
+
+    void apply(size_t pos, size_t removed, std::string_view inserted, std::string const& t) {
+        ASSERT_LE(pos + removed, copy.size());
+        copy.replace(pos, removed, inserted);
+        ASSERT_EQ(copy, t);
+    }
+};
+
+struct counting_replica {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceEditAugmentation);
+    replica* r;
+    size_t edits = 0;
+    size_t full = 0; // steps reported without the edit
+
+    void operator()(auto p, std::string const& t) {
+        ++full;
+        r->apply(0, r->copy.size(), t, t);
+    }
+    void edit(auto p, size_t pos, size_t removed, std::string_view inserted, std::string const& t) {
+        ++edits;
+        r->apply(pos, removed, inserted, t);
+    }
+    bool operator == (counting_replica const&) const { return true; }
+};
+
+template<auto m> void expect_replicated(std::string src, size_t full = 0) {
+    replica r{src};
+    auto dst = m(inplace_augmented_text{src, counting_replica{&r}});
+    EXPECT_EQ(dst.text, m(src));
+    EXPECT_EQ(r.copy, dst.text);
+    EXPECT_EQ(dst.aux.full, full);
+}
+
+TEST(inplace_edit, rules_and_facades) {
+    expect_replicated<MACHINE(collatz)>("<1111111>");
+    // facade over a series, and a facade of a facade
+    constexpr auto facades = RULES(
+        FACADE_RULE("del", RULES(RULE("ab", ""), RULE("ba", ""))),
+        FACADE_RULE("outer", FACADE_RULE("inner", RULE("a", "bb"))),
+        FINAL_RULE("bb", "ok")
+    );
+    expect_replicated<MACHINE(facades)>("aabab");
+    // the same, not flattenable (because of the loop, which never matches):
+    // the steps go through rule::update and facade_rule::update
+    expect_replicated<MACHINE(RULES(facades, RULE_LOOP(RULE("x", "y"))))>("aabab");
+}
+
+TEST(inplace_edit, unknown_edits) {
+    // hidden steps inside a facade: the facade doesn't know the edit, so it reports the whole text
+    // (the flat loop doesn't report them at all)
+    expect_replicated<MACHINE(RULES(
+        FACADE_RULE("f", RULES(HIDDEN_RULE(RULE("a", "")), RULE("b", "c"))),
+        FINAL_RULE("c", "d"),
+        RULE_LOOP(RULE("x", "y"))
+    ))>("abab", 2);
+    // several steps inside a facade
+    expect_replicated<MACHINE(RULES(FACADE_RULE("f", RULE_LOOP(RULE("ab", "b"))), RULE("b", "cc")))>("aab", 1);
+}
+
+// a bulk augmentation gets a walk as a single edit of the walked region
+struct walk_replica {
+    REPRESENTS(InplaceAugmentation);
+    REPRESENTS(InplaceBulkAugmentation);
+    REPRESENTS(InplaceEditAugmentation);
+    replica* r;
+    size_t steps = 0;
+    size_t bulks = 0;
+
+    void operator()(auto p, std::string const& t) { ADD_FAILURE(); }
+    void bulk(auto p, std::string const& t, size_t n) { ADD_FAILURE(); }
+    void edit(auto p, size_t pos, size_t removed, std::string_view inserted, std::string const& t) {
+        bulk_edit(p, pos, removed, inserted, t, 1);
+    }
+    void bulk_edit(auto p, size_t pos, size_t removed, std::string_view inserted, std::string const& t, size_t n) {
+        steps += n;
+        bulks += n > 1;
+        r->apply(pos, removed, inserted, t);
+    }
+    bool operator == (walk_replica const&) const { return true; }
+};
+
+TEST(inplace_edit, walks) {
+    constexpr auto m = MACHINE(RULES(RULE("c11", "11c"), RULE("c1", "1c"), FINAL_RULE("c", "")));
+    std::string src = "xc" + std::string(21, '1') + "y";
+    replica r{src};
+    auto dst = m(inplace_augmented_text{src, walk_replica{&r}});
+    EXPECT_EQ(dst.text, m(src));
+    EXPECT_EQ(r.copy, dst.text);
+    EXPECT_EQ(dst.aux.steps, 12u);
+    EXPECT_GE(dst.aux.bulks, 1u);
+}
+
+TEST(inplace_edit, ring_tracer_positions) {
+    std::string src = "<1111111>";
+    std::vector<size_t> positions;
+    std::string copy = src;
+    machine_fun_v<RULE_LOOP(collatz)>(inplace_augmented_text{src, inplace_edit_effect{
+        [&](auto, size_t pos, size_t, std::string_view, std::string const&) { positions.push_back(pos); }, src.size()}});
+
+    trace_ring ring{1 << 10};
+    MACHINE(collatz)(inplace_augmented_text{src, inplace_ring_tracer{&ring, false}});
+    std::vector<trace_event> events(positions.size() + 1);
+    events.resize(ring.pop(events));
+    size_t step = 0;
+    for (trace_event const& e : events) {
+        EXPECT_EQ(e.pos, positions[step]) << step; // a walk: the position of its first step
+        step += e.count;
+    }
+    EXPECT_EQ(step, positions.size());
+}
+
+}} // namespace nn
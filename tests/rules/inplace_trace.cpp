@@ -0,0 +1,118 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+constexpr auto machine = MACHINE(collatz);
+
+struct reference {
+    std::vector<std::string> rules{""};
+    std::vector<std::string> texts;
+};
+
+reference reference_run(std::string const& src) {
+    reference ref;
+    ref.texts.push_back(src);
+    machine(inplace_augmented_text{src, inplace_side_effect{[&](auto p, std::string const& t) {
+        std::ostringstream ss;
+        ss << p;
+        ref.rules.push_back(ss.str());
+        ref.texts.push_back(t);
+    }}});
+    return ref;
+}
+
+TEST(inplace_trace, record_and_read) {
+    std::string src = "<1111111>";
+    reference ref = reference_run(src);
+
+    for (size_t k : {1, 2, 7, 1000}) {
+        std::ostringstream os;
+        auto dst = machine(inplace_augmented_text{src, inplace_trace_recorder{os, src, k}});
+        EXPECT_EQ(dst.text, ref.texts.back());
+
+        trace_reader reader{os.str()};
+        ASSERT_EQ(reader.steps(), ref.texts.size() - 1);
+        EXPECT_EQ(reader.keyframe_interval(), k);
+        for (size_t i = 0; i != ref.texts.size(); ++i) {
+            EXPECT_EQ(reader.text_at(i), ref.texts[i]) << i;
+            EXPECT_EQ(reader.rule_at(i), ref.rules[i]) << i;
+        }
+        EXPECT_EQ(reader.rule_at(reader.steps()), "stop");
+
+        size_t from = 5, to = 40, seen = 0;
+        reader.for_each(from, to, [&](size_t step, std::string_view rule, std::string const& text) {
+            EXPECT_EQ(step, from + seen);
+            EXPECT_EQ(rule, ref.rules[step]);
+            EXPECT_EQ(text, ref.texts[step]);
+            ++seen;
+        });
+        EXPECT_EQ(seen, to - from + 1);
+        EXPECT_THROW(reader.text_at(reader.steps() + 1), std::out_of_range);
+    }
+}
+
+TEST(inplace_trace, file) {
+    std::string src = "<111>";
+    auto path = (std::filesystem::temp_directory_path() / "nenormal_inplace_trace.bin").string();
+    {
+        std::ofstream os{path, std::ios::binary};
+        machine(inplace_augmented_text{src, inplace_trace_recorder{os, src, 3}});
+    }
+    reference ref = reference_run(src);
+    {
+        trace_reader reader = trace_reader::from_file(path);
+        ASSERT_EQ(reader.steps(), ref.texts.size() - 1);
+        EXPECT_EQ(reader.text_at(reader.steps()), ref.texts.back());
+    }
+    std::remove(path.c_str());
+
+    EXPECT_THROW(trace_reader{std::string("garbage")}, std::runtime_error);
+}
+
+TEST(inplace_trace, overhead) {
+    // compare a run without augmentation, with a full-text trace and with a binary trace
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<collatz, rule_loop_unlimited_v>{}));
+    std::string src = "<" + std::string(300, '1') + ">";
+    auto measure = [](auto&& f) {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+    size_t steps = 0;
+    size_t text_bytes = 0;
+    double plain = measure([&] { m(src); });
+    double full = measure([&] {
+        m(inplace_augmented_text{src, inplace_side_effect{[&](auto, std::string const& t) {
+            ++steps;
+            text_bytes += t.size();
+        }}});
+    });
+    std::ostringstream os;
+    double binary = measure([&] { m(inplace_augmented_text{src, inplace_trace_recorder{os, src, 1000}}); });
+
+    std::cout << steps << " steps: plain " << plain << " ms, "
+              << "full-text callback " << full << " ms (" << text_bytes << " bytes of text), "
+              << "binary trace " << binary << " ms (" << os.str().size() << " bytes)" << std::endl;
+    EXPECT_LT(os.str().size(), text_bytes);
+    EXPECT_EQ(trace_reader{os.str()}.steps(), steps);
+}
+
+} } // namespace nn
@@ -0,0 +1,83 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <stop_token>
+#include <thread>
+
+namespace nn { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE"),
+    FINAL_RULE("", "OK")
+);
+
+// endless cycle of cheap steps
+constexpr auto cycle = RULES(RULE("a", "b"), RULE("b", "c"), RULE("c", "a"));
+
+TEST(interruptible, not_interrupted) {
+    constexpr auto m = MACHINE(brackets);
+    for (std::string src : {"", "(()", "(()())"}) {
+        machine_state<std::string> s = m(src, std::stop_token{});
+        EXPECT_TRUE(s.finished);
+        EXPECT_EQ(s.text, m(src));
+        EXPECT_EQ(s.budget, rule_loop_limit_v - s.steps);
+    }
+}
+
+TEST(interruptible, stop_token) {
+    constexpr auto m = MACHINE(brackets);
+    std::stop_source stop;
+    stop.request_stop();
+    machine_state<std::string> s = m(std::string("(()"), stop.get_token());
+    EXPECT_FALSE(s.finished);
+    EXPECT_EQ(s.steps, 0);
+    s = m(std::move(s), std::stop_token{}); // resume
+    EXPECT_TRUE(s.finished);
+    EXPECT_EQ(s.text, "FAILURE");
+    EXPECT_EQ(s.steps, 3);
+}
+
+TEST(interruptible, deadline_and_resume) {
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<cycle, 100000000>{}));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{20};
+    machine_state<std::string> s = m(std::string("a"), deadline);
+    EXPECT_FALSE(s.finished);
+    EXPECT_GT(s.steps, 0);
+    EXPECT_EQ(s.steps % interrupt_check_period_v, 0);
+    EXPECT_EQ(s.steps + s.budget, 100000000);
+    EXPECT_EQ(s.text, std::string(1, "abc"[s.steps % 3]));
+
+    // resuming continues the same run
+    size_t before = s.steps;
+    s = m(std::move(s), std::chrono::steady_clock::now() + std::chrono::milliseconds{5});
+    EXPECT_GT(s.steps, before);
+    EXPECT_EQ(s.text, std::string(1, "abc"[s.steps % 3]));
+}
+
+TEST(interruptible, stop_from_another_thread) {
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<cycle, rule_loop_unlimited_v>{}));
+    std::jthread worker{[&](std::stop_token stop) {
+        machine_state<std::string> s = m(std::string("a"), stop);
+        EXPECT_FALSE(s.finished);
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    worker.request_stop();
+}
+
+TEST(interruptible, augmented_and_non_flat) {
+    // rule loops are not flattenable, so every step is done by p.update
+    constexpr auto nested = RULE_LOOP(brackets);
+    constexpr auto m = MACHINE(nested);
+    auto a = inplace_augmented_text{std::string("(()"), inplace_cumulative_effect{size_t{0}, [](size_t n, auto, auto const&) { return n + 1; }}};
+    auto s = m(std::move(a), std::stop_token{});
+    EXPECT_TRUE(s.finished);
+    EXPECT_EQ(s.text.text, "FAILURE");
+    EXPECT_EQ(s.text.aux.a, 3);
+}
+
+} } // namespace nn
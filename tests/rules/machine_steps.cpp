@@ -0,0 +1,95 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <algorithm>
+#include <ranges>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE")
+);
+
+static_assert(std::ranges::input_range<generator<step_event>>);
+static_assert(std::ranges::view<generator<step_event>>);
+
+TEST(machine_steps, events) {
+    constexpr auto m = MACHINE(brackets);
+    std::string t = "(()";
+    std::vector<std::string> texts;
+    std::vector<size_t> leaves;
+    for (step_event const& e : m.steps(t)) {
+        texts.emplace_back(e.text);
+        leaves.push_back(e.leaf);
+        EXPECT_EQ(e.step, texts.size());
+    }
+    EXPECT_EQ(texts, (std::vector<std::string>{"(", "_", "FAILURE"}));
+    EXPECT_EQ(leaves, (std::vector<size_t>{0, 1, 4}));
+    EXPECT_EQ(t, m(std::string("(()")));
+}
+
+TEST(machine_steps, identity_and_position) {
+    std::string t = "a()b";
+    auto steps = machine_steps<brackets>(t);
+    auto it = steps.begin();
+    ASSERT_NE(it, steps.end());
+    EXPECT_EQ(it->search, "()");
+    EXPECT_EQ(it->replace, "");
+    EXPECT_EQ(it->pos, 1);
+    EXPECT_EQ(it->kind, tristate_kind::matched_regular);
+    ++it;
+    EXPECT_EQ(it, steps.end()); // "ab" matches nothing
+}
+
+TEST(machine_steps, early_stop) {
+    constexpr auto m = MACHINE(brackets);
+    std::string t = std::string(100, '(');
+    size_t n = 0;
+    for (auto const& e : m.steps(t)) {
+        if (++n == 3)
+            break;
+    }
+    EXPECT_EQ(t, "___" + std::string(97, '('));
+}
+
+TEST(machine_steps, ranges) {
+    constexpr auto m = MACHINE(brackets);
+    std::string t = "(())((";
+    auto finals = m.steps(t)
+        | std::views::filter([](step_event const& e) { return e.kind == tristate_kind::matched_final; })
+        | std::views::transform([](step_event const& e) { return std::string{e.replace}; });
+    std::vector<std::string> v;
+    std::ranges::copy(finals, std::back_inserter(v));
+    EXPECT_EQ(v, (std::vector<std::string>{"FAILURE"}));
+}
+
+TEST(machine_steps, walks_and_limits) {
+    // a walk is a single event of many steps
+    constexpr auto walk = RULE("ab", "ba");
+    std::string t = "a" + std::string(10, 'b');
+    size_t events = 0, last = 0;
+    for (auto const& e : machine_steps<walk>(t)) {
+        ++events;
+        last = e.step;
+    }
+    EXPECT_EQ(events, 1);
+    EXPECT_EQ(last, 10);
+
+    // limit of the machine
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<brackets, 2>{}));
+    std::string u = "(((";
+    EXPECT_EQ(std::ranges::distance(m.steps(u)), 2);
+    EXPECT_EQ(u, "__(");
+
+    // augmentation sees the steps
+    auto a = inplace_augmented_text{std::string("(()"), inplace_cumulative_effect{size_t{0}, [](size_t n, auto, auto const&) { return n + 1; }}};
+    EXPECT_EQ(std::ranges::distance(MACHINE(brackets).steps(a)), 3);
+    EXPECT_EQ(a.aux.a, 3);
+}
+
+} } // namespace nn
@@ -0,0 +1,75 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <random>
+
+namespace nn { namespace {
+
+constexpr std::array<bool, 256> bytes_of(std::string_view s) {
+    std::array<bool, 256> bytes{};
+    for (char c : s)
+        bytes[static_cast<unsigned char>(c)] = true;
+    return bytes;
+}
+
+TEST(marker_index, positions) {
+    std::string text(marker_index::min_text, '1');
+    text[10] = '[';
+    text[100] = ']';
+    text[200] = '[';
+    marker_index index{text, byte_histogram{text}, bytes_of("[]1")};
+    EXPECT_FALSE(index.indexed('1')); // not rare
+    EXPECT_TRUE(index.indexed('['));
+    EXPECT_EQ(index.positions('['), (std::vector<size_t>{10, 200}));
+
+    constexpr auto req = byte_requirement_v<STR("1[")>;
+    EXPECT_TRUE(index.anchors(req));
+    EXPECT_FALSE(index.anchors(byte_requirement_v<STR("11")>));
+    EXPECT_EQ(index.find_leftmost(text, "1[", req), 9);
+    EXPECT_EQ(index.find_leftmost(text, "[1]", byte_requirement_v<STR("[1]")>), marker_index::npos);
+
+    // "1[" -> "[[]"
+    text.replace(9, 2, "[[]");
+    index.substitute(text, 9, 2, 3);
+    EXPECT_EQ(index.positions('['), (std::vector<size_t>{9, 10, 201}));
+    EXPECT_EQ(index.positions(']'), (std::vector<size_t>{11, 101}));
+
+    // a marker which gets frequent is dropped
+    text.replace(0, 0, std::string(marker_index::min_text, '['));
+    index.substitute(text, 0, 0, marker_index::min_text);
+    EXPECT_FALSE(index.indexed('['));
+    EXPECT_TRUE(index.indexed(']'));
+}
+
+// reference run: one p.update per step
+std::string reference_run(Rule auto p, std::string t) {
+    for (size_t steps = 0; steps != rule_loop_limit_v; ++steps) {
+        tristate_kind k = p.update(t);
+        if (k != tristate_kind::matched_regular)
+            break;
+    }
+    return t;
+}
+
+// x moves right eating every second one, turns into a tail at the end
+constexpr auto markers = RULES(
+    RULE("x11", "1x"),
+    RULE("x1", "y"),
+    RULE("x", "y"),
+    RULE("1y", "y1"),
+    RULE("[y", "[z"),
+    RULE("z1", "1z"),
+    FINAL_RULE("z]", "]")
+);
+
+TEST(marker_index, program) {
+    constexpr auto m = MACHINE(markers);
+    std::mt19937 gen{7};
+    for (size_t i = 0; i != 5; ++i) {
+        std::string src = "[x" + std::string(marker_index::min_text + gen() % 1000, '1') + "]";
+        src.insert(2 + gen() % 100, "x");
+        EXPECT_EQ(m(src), reference_run(markers, src));
+    }
+}
+
+} } // namespace nn
@@ -0,0 +1,98 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <thread>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FINAL_RULE("<1>", "")
+);
+
+size_t reference_steps(std::string& t, size_t limit = rule_loop_limit_v) {
+    size_t steps = 0;
+    while (steps < limit) {
+        tristate_kind k = collatz.update(t);
+        if (k == tristate_kind::not_matched_yet)
+            break;
+        ++steps;
+        if (k == tristate_kind::matched_final)
+            break;
+    }
+    return steps;
+}
+
+std::string input(size_t n) { return "<" + std::string(n, '1') + ">"; }
+
+TEST(memo, cache) {
+    memo_cache cache{4, 1};
+    EXPECT_FALSE(cache.find("a"));
+    cache.insert("a", {"x", 1});
+    cache.insert("a", {"y", 2}); // the first one stays
+    EXPECT_EQ(cache.find("a"), (memo_entry{"x", 1}));
+    for (std::string k : {"b", "c", "d", "e"})
+        cache.insert(k, {k, 0});
+    EXPECT_EQ(cache.size(), 4);
+    EXPECT_FALSE(cache.find("a")); // evicted as the oldest
+    EXPECT_TRUE(cache.find("e"));
+    EXPECT_EQ(cache.hits(), 2);
+    EXPECT_EQ(cache.misses(), 2);
+}
+
+TEST(memo, batch) {
+    memo_cache cache{100000};
+    memoized_machine<collatz, rule_loop_unlimited_v, 8> m{cache};
+    for (size_t n = 1; n <= 20; ++n) {
+        std::string expected = input(n);
+        size_t steps = reference_steps(expected, rule_loop_unlimited_v);
+        memo_result r = m.run(input(n));
+        EXPECT_EQ(r, (memo_result{expected, steps})) << n;
+    }
+    // trajectories merge, so later runs end early
+    EXPECT_GT(cache.hits(), 0);
+
+    // the whole run is cached by now
+    size_t hits = cache.hits();
+    EXPECT_EQ(m(input(15)), "");
+    EXPECT_EQ(cache.hits(), hits + 1);
+}
+
+TEST(memo, limit) {
+    memo_cache cache{1000};
+    memoized_machine<collatz, 100, 4> m{cache};
+    for (size_t n : {27, 27, 9, 27, 3}) {
+        std::string expected = input(n);
+        size_t steps = reference_steps(expected, 100);
+        EXPECT_EQ(m.run(input(n)), (memo_result{expected, steps})) << n;
+    }
+}
+
+TEST(memo, concurrent) {
+    memo_cache cache{10000};
+    memoized_machine<collatz, rule_loop_unlimited_v, 4> m{cache};
+    std::vector<std::thread> threads;
+    std::vector<int> ok(4, 1);
+    for (size_t i = 0; i != ok.size(); ++i) {
+        threads.emplace_back([&, i] {
+            for (size_t n = 1 + i; n <= 20; n += ok.size()) {
+                std::string expected = input(n);
+                size_t steps = reference_steps(expected, rule_loop_unlimited_v);
+                if (m.run(input(n)) != memo_result{expected, steps})
+                    ok[i] = 0;
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    EXPECT_EQ(ok, std::vector<int>(ok.size(), 1));
+}
+
+} } // namespace nn
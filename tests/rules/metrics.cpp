@@ -0,0 +1,138 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+constexpr auto machine = MACHINE(collatz);
+// not flattenable; steps of both loops are counted
+constexpr auto nested_machine = MACHINE(RULES(RULE_LOOP(RULE("ab", "b")), FINAL_RULE("b", "ok")));
+// never stops
+constexpr auto endless = machine_fun_v<rule_loop_v<RULE("a", "aa"), 10>>;
+
+size_t steps_of(std::string src) {
+    return machine(machine_state<std::string>{std::move(src), 0, rule_loop_limit_v}, std::stop_token{}).steps;
+}
+
+metrics_snapshot::program program_of(metrics_snapshot const& s, std::string const& name) {
+    for (auto const& p : s.programs)
+        if (p.name == name)
+            return p;
+    return {name};
+}
+
+TEST(machine_metrics, off_by_default) {
+    auto& m = machine_metrics::instance();
+    ASSERT_FALSE(m.enabled());
+    machine(std::string("<111>"));
+    EXPECT_EQ(m.snapshot(), metrics_snapshot{});
+}
+
+TEST(machine_metrics, counters) {
+    auto& m = machine_metrics::instance();
+    std::string const key = machine_metrics::fingerprint_key(rule_fingerprint_v<rule_loop_v<collatz>>);
+    size_t steps = steps_of("<11111>") + steps_of("<111>");
+    std::string expected = machine(std::string("<11111>"));
+    m.enable();
+    metrics_snapshot before = m.snapshot();
+    EXPECT_EQ(machine(std::string("<11111>")), expected);
+    EXPECT_TRUE(machine(machine_state<std::string>{"<111>", 0, rule_loop_limit_v}, std::stop_token{}).finished);
+    EXPECT_EQ(nested_machine(std::string("aab")), "b"); // the inner loop stops the outer one
+    EXPECT_EQ(endless(std::string("a")), std::string(11, 'a'));
+    metrics_snapshot after = m.snapshot();
+    m.enable(false);
+
+    EXPECT_EQ(after.runs - before.runs, 4u);
+    EXPECT_EQ(after.steps - before.steps, steps + 2 + 1 + 10);
+    EXPECT_EQ(after.limit_aborts - before.limit_aborts, 1u);
+    EXPECT_EQ(after.in_flight, 0);
+    EXPECT_EQ(after.text_bytes, 0);
+    auto p = program_of(after, key);
+    auto q = program_of(before, key);
+    EXPECT_EQ(p.runs - q.runs, 2u);
+    EXPECT_EQ(p.steps - q.steps, steps);
+    EXPECT_EQ(p.limit_aborts - q.limit_aborts, 0u);
+}
+
+TEST(machine_metrics, gauges_in_flight) {
+    auto& m = machine_metrics::instance();
+    m.enable();
+    metrics_snapshot inside;
+    std::string src = "<1111>";
+    machine(inplace_augmented_text{src, inplace_side_effect{[&](auto, std::string const&) {
+        if (inside.runs == 0)
+            inside = m.snapshot();
+    }}});
+    m.enable(false);
+    EXPECT_EQ(inside.in_flight, 1);
+    EXPECT_EQ(inside.text_bytes, static_cast<int64_t>(src.size()));
+    EXPECT_EQ(m.snapshot().in_flight, 0);
+}
+
+TEST(machine_metrics, threads) {
+    auto& m = machine_metrics::instance();
+    std::string const key = machine_metrics::fingerprint_key(rule_fingerprint_v<rule_loop_v<collatz>>);
+    constexpr size_t threads = 4, runs = 50;
+    m.enable();
+    metrics_snapshot before = m.snapshot();
+    std::vector<std::thread> ts;
+    for (size_t i = 0; i != threads; ++i)
+        ts.emplace_back([] {
+            for (size_t k = 0; k != runs; ++k)
+                machine(std::string("<111>"));
+        });
+    for (auto& t : ts)
+        t.join();
+    metrics_snapshot after = m.snapshot(); // the threads are over, their shards are retired
+    m.enable(false);
+    EXPECT_EQ(after.runs - before.runs, threads * runs);
+    EXPECT_EQ(after.steps - before.steps, threads * runs * steps_of("<111>"));
+    EXPECT_EQ(program_of(after, key).runs - program_of(before, key).runs, threads * runs);
+}
+
+TEST(machine_metrics, export) {
+    auto& m = machine_metrics::instance();
+    m.name_program(rule_fingerprint_v<rule_loop_v<collatz>>, "collatz \"3n+1\"");
+    m.enable();
+    machine(std::string("<11>"));
+    m.enable(false);
+    metrics_snapshot s = m.snapshot();
+
+    std::string prom = s.prometheus();
+    EXPECT_NE(prom.find("# TYPE nenormal_runs_total counter\nnenormal_runs_total " + std::to_string(s.runs) + "\n"), std::string::npos);
+    EXPECT_NE(prom.find("# TYPE nenormal_machines_in_flight gauge\n"), std::string::npos);
+    auto p = program_of(s, "collatz \"3n+1\"");
+    EXPECT_GE(p.runs, 1u);
+    EXPECT_NE(prom.find("nenormal_program_runs_total{program=\"collatz \\\"3n+1\\\"\"} " + std::to_string(p.runs) + "\n"), std::string::npos);
+
+    std::string json = s.json();
+    EXPECT_EQ(json.substr(0, 9 + std::to_string(s.runs).size()), "{\"runs\":" + std::to_string(s.runs) + ",");
+    EXPECT_NE(json.find("{\"program\":\"collatz \\\"3n+1\\\"\",\"runs\":" + std::to_string(p.runs) + ","), std::string::npos);
+
+    auto path = std::filesystem::temp_directory_path() / "nenormal_metrics_test.prom";
+    m.write(path.string(), metrics_format::prometheus);
+    std::ifstream f{path};
+    std::stringstream content;
+    content << f.rdbuf();
+    EXPECT_EQ(content.str(), prom);
+    EXPECT_FALSE(std::filesystem::exists(path.string() + ".tmp"));
+    std::filesystem::remove(path);
+}
+
+}} // namespace nn
@@ -0,0 +1,73 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include "utils.h"
+#include <random>
+
+namespace nn { namespace {
+
+constexpr auto program = RULES(
+    RULE("abc", "x"),
+    HIDDEN_RULE(RULE("ba", "ab")),
+    FACADE_RULE("f", RULES(RULE("cc", "c"), FINAL_RULE("xx", "y"))),
+    RULE("c", "")
+);
+
+std::string random_text(size_t n, unsigned seed) {
+    std::mt19937 gen{seed};
+    std::string s(n, ' ');
+    for (char& c : s)
+        c = "abcx"[gen() % 4];
+    return s;
+}
+
+TEST(parallel_rule, same_step) {
+    constexpr auto pp = parallel_rule_v<program, 1>;
+    for (size_t n : {0, 1, 2, 3, 5, 17, 100, 1000}) {
+        for (unsigned seed = 0; seed != 10; ++seed) {
+            std::string src = random_text(n, seed);
+            auto expected = call_inplace_ex(program, src);
+            auto actual = call_inplace_ex(pp, src);
+            EXPECT_EQ(actual, expected) << src;
+        }
+    }
+}
+
+TEST(parallel_rule, empty_search) {
+    constexpr auto p = RULES(RULE("zz", "z"), RULE("", "!"));
+    constexpr auto pp = parallel_rule_v<p, 1>;
+    for (std::string src : {"", "a", "abzz", "abcdefghijklmnopqrstuvwxyz"})
+        EXPECT_EQ(call_inplace_ex(pp, src), call_inplace_ex(p, src)) << src;
+}
+
+TEST(parallel_rule, augmentation) {
+    constexpr auto m = MACHINE(program);
+    constexpr auto pm = MACHINE((parallel_rule_v<program, 1>));
+    auto names = [](std::vector<std::string> v, auto p, std::string const& t) {
+        std::ostringstream ss;
+        ss << p;
+        v.push_back(ss.str() + ":" + t);
+        return v;
+    };
+    for (unsigned seed = 0; seed != 10; ++seed) {
+        std::string src = random_text(200, seed);
+        auto expected = m(inplace_augmented_text{src, inplace_cumulative_effect{std::vector<std::string>{}, names}});
+        auto actual = pm(inplace_augmented_text{src, inplace_cumulative_effect{std::vector<std::string>{}, names}});
+        EXPECT_EQ(actual, expected) << src;
+    }
+}
+
+TEST(parallel_rule, huge_text) {
+    // a single occurrence near the end of a huge text
+    constexpr auto p = RULES(RULE("ab", "ba"), RULE("z", "y"));
+    constexpr auto pp = PARALLEL_RULE(p);
+    std::string src(parallel_rule_threshold_v * 4, 'a');
+    src[src.size() - 10] = 'z';
+    src.back() = 'b';
+    auto expected = call_inplace_ex(p, src);
+    auto actual = call_inplace_ex(pp, src);
+    EXPECT_EQ(actual.kind, tristate_kind::matched_regular);
+    EXPECT_TRUE(actual.value == expected.value);
+}
+
+} } // namespace nn
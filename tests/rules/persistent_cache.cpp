@@ -0,0 +1,109 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <filesystem>
+#include <thread>
+
+namespace nn { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE")
+);
+using machine = cached_machine<brackets>;
+
+struct cache_file {
+    std::string path = (std::filesystem::temp_directory_path() / "nenormal_persistent_cache").string();
+    cache_file() { std::filesystem::remove(path); }
+    ~cache_file() { std::filesystem::remove(path); std::filesystem::remove(path + ".tmp"); }
+};
+
+TEST(persistent_cache, find_insert) {
+    cache_file file;
+    persistent_cache cache{file.path, 1, 4096, 4};
+    EXPECT_FALSE(cache.find("a"));
+    cache.insert("a", "x");
+    cache.insert("", "empty");
+    EXPECT_EQ(cache.find("a"), "x");
+    EXPECT_EQ(cache.find(""), "empty");
+    cache.insert("a", "y"); // shadows the old value
+    EXPECT_EQ(cache.find("a"), "y");
+    EXPECT_EQ(cache.entries(), 3);
+    cache.compact();
+    EXPECT_EQ(cache.entries(), 2);
+    EXPECT_EQ(cache.find("a"), "y");
+}
+
+TEST(persistent_cache, persistence_and_invalidation) {
+    cache_file file;
+    {
+        persistent_cache cache{file.path, 1};
+        cache.insert("key", "value");
+    }
+    {
+        persistent_cache cache{file.path, 1};
+        EXPECT_EQ(cache.find("key"), "value");
+    }
+    {
+        persistent_cache cache{file.path, 2}; // another program
+        EXPECT_FALSE(cache.find("key"));
+    }
+}
+
+TEST(persistent_cache, grows) {
+    cache_file file;
+    persistent_cache cache{file.path, 1, 4096, 16};
+    for (size_t i = 0; i != 1000; ++i)
+        cache.insert(std::to_string(i), std::string(i % 50, 'v'));
+    for (size_t i = 0; i != 1000; ++i)
+        EXPECT_EQ(cache.find(std::to_string(i)), std::string(i % 50, 'v')) << i;
+
+    // another instance sees the compacted file
+    persistent_cache other{file.path, 1, 4096, 16};
+    EXPECT_EQ(other.find("999"), std::string(999 % 50, 'v'));
+}
+
+TEST(persistent_cache, machine) {
+    cache_file file;
+    persistent_cache cache{file.path, machine::fingerprint};
+    machine m{cache};
+    for (std::string src : {"", "()", "(()", "([)]", "(()())(())"})
+        EXPECT_EQ(m(src), MACHINE(brackets)(src)) << src;
+    EXPECT_EQ(cache.entries(), 5);
+    EXPECT_EQ(m("(()"), "FAILURE");
+    EXPECT_EQ(cache.entries(), 5);
+
+    persistent_cache wrong{file.path + "2", 42};
+    EXPECT_THROW(machine{wrong}, std::invalid_argument);
+    std::filesystem::remove(file.path + "2");
+}
+
+TEST(persistent_cache, concurrent_readers) {
+    cache_file file;
+    persistent_cache cache{file.path, 1, 1 << 12, 64};
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> bad = 0;
+    std::vector<std::thread> readers;
+    for (int r = 0; r != 4; ++r) {
+        readers.emplace_back([&] {
+            while (!stop) {
+                for (size_t i = 0; i != 100; ++i) {
+                    auto v = cache.find(std::to_string(i));
+                    if (v && *v != std::to_string(i * i))
+                        ++bad;
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i != 2000; ++i)
+        cache.insert(std::to_string(i % 100), std::to_string((i % 100) * (i % 100)));
+    stop = true;
+    for (auto& t : readers)
+        t.join();
+    EXPECT_EQ(bad, 0);
+}
+
+} } // namespace nn
@@ -0,0 +1,87 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace nn { namespace {
+
+template<Str auto s, Str auto r>
+void expect_same_substitution(piece_text& t, std::string& expected) {
+    bool expected_ok = try_substitute_inplace(ct<s>{}, ct<r>{}, expected);
+    bool ok = try_substitute_inplace(ct<s>{}, ct<r>{}, t);
+    EXPECT_EQ(ok, expected_ok) << expected;
+    EXPECT_EQ(t.str(), expected);
+}
+
+TEST(piece_text, substitute) {
+    piece_text t{std::string("abcabc")};
+    std::string expected = "abcabc";
+    expect_same_substitution<STR("b"), STR("xyz")>(t, expected);  // axyzcabc
+    expect_same_substitution<STR("zca"), STR("")>(t, expected);   // across pieces: axybc
+    expect_same_substitution<STR("yb"), STR("yb")>(t, expected);
+    expect_same_substitution<STR("axybc"), STR("")>(t, expected); // whole text
+    expect_same_substitution<STR(""), STR("!")>(t, expected);     // empty text
+    expect_same_substitution<STR("?"), STR("")>(t, expected);
+    EXPECT_EQ(t.pieces().size(), 1);
+}
+
+TEST(piece_text, random_edits) {
+    std::mt19937 gen{42};
+    std::string expected(5000, ' ');
+    for (char& c : expected)
+        c = "ab"[gen() % 2];
+    piece_text t{expected};
+    for (size_t i = 0; i != 3000; ++i) {
+        switch (gen() % 4) {
+        case 0: expect_same_substitution<STR("ab"), STR("ba")>(t, expected); break;
+        case 1: expect_same_substitution<STR("aab"), STR("b")>(t, expected); break;
+        case 2: expect_same_substitution<STR("bbb"), STR("abbba")>(t, expected); break;
+        case 3: expect_same_substitution<STR("ba"), STR("")>(t, expected); break;
+        }
+    }
+}
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE")
+);
+
+TEST(piece_text, file) {
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<brackets, rule_loop_unlimited_v>{}));
+    auto dir = std::filesystem::temp_directory_path();
+    auto in = (dir / "nenormal_piece_text_in.txt").string();
+    auto out = (dir / "nenormal_piece_text_out.txt").string();
+
+    for (std::string src : {std::string(""), std::string("(()())"), std::string(3000, '(') + std::string(3000, ')') + "("}) {
+        std::ofstream{in, std::ios::binary} << src;
+        piece_text dst = m(piece_text::from_file(in));
+        dst.write_file(out);
+        std::ostringstream ss;
+        ss << std::ifstream{out, std::ios::binary}.rdbuf();
+        EXPECT_EQ(ss.str(), m(src));
+    }
+    std::remove(in.c_str());
+    std::remove(out.c_str());
+
+    EXPECT_THROW(piece_text::from_file((dir / "nenormal_no_such_file").string()), std::system_error);
+}
+
+TEST(piece_text, compaction) {
+    // many deletions in the middle split the text into many pieces
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<RULE("()", ""), rule_loop_unlimited_v>{}));
+    std::string src;
+    for (size_t i = 0; i != 10000; ++i)
+        src += "a()";
+    piece_text dst = m(piece_text{src});
+    EXPECT_EQ(dst.str(), std::string(10000, 'a'));
+    EXPECT_LT(dst.pieces().size(), 2 * piece_text::compact_min_pieces);
+}
+
+} } // namespace nn
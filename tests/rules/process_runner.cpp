@@ -0,0 +1,83 @@
+#include "nenormal/nenormal.h"
+#include "nenormal/parallel/process_runner.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE"),
+    FINAL_RULE("", "OK")
+);
+
+machine_result run_brackets(std::string text) {
+    auto s = run_interruptible<brackets>(machine_state<std::string>{std::move(text), 0, rule_loop_limit_v}, std::stop_token{});
+    return {std::move(s.text), s.steps};
+}
+
+TEST(process_runner, same_as_machine) {
+    constexpr auto m = MACHINE(brackets);
+    std::vector<std::string> texts;
+    for (size_t i = 0; i != 500; ++i)
+        texts.push_back(std::string(i % 9, '(') + std::string((i / 9) % 9, ')'));
+    std::vector<std::string_view> inputs(texts.begin(), texts.end());
+
+    process_runner runner{run_brackets, {3}};
+    std::vector<process_result> results = runner.run(inputs);
+    ASSERT_EQ(results.size(), inputs.size());
+    for (size_t i = 0; i != inputs.size(); ++i) {
+        EXPECT_EQ(results[i].status, process_status::ok);
+        EXPECT_EQ(results[i].text, m(texts[i]));
+        EXPECT_EQ(results[i].steps, run_brackets(texts[i]).steps);
+    }
+    EXPECT_EQ(runner.respawns(), 0u);
+    EXPECT_TRUE(runner.run({}).empty());
+}
+
+TEST(process_runner, faults_are_isolated) {
+    auto f = [](std::string text) {
+        if (text == "crash")
+            std::abort();
+        if (text == "hang")
+            while (true) {}
+        if (text == "throw")
+            throw std::runtime_error("bad input");
+        return run_brackets(std::move(text));
+    };
+    std::vector<std::string_view> inputs = {"()", "crash", "(()", "hang", "throw", "()()", "crash", "(", ""};
+    process_runner runner{f, {2, std::chrono::milliseconds{200}}};
+    std::vector<process_result> r = runner.run(inputs);
+
+    EXPECT_EQ(r[0], (process_result{process_status::ok, "OK", 2}));
+    EXPECT_EQ(r[1].status, process_status::crashed);
+    EXPECT_EQ(r[2].status, process_status::ok);
+    EXPECT_EQ(r[2].text, "FAILURE");
+    EXPECT_EQ(r[3].status, process_status::timeout);
+    EXPECT_EQ(r[4], (process_result{process_status::error, "bad input", 0}));
+    EXPECT_EQ(r[5].text, "OK");
+    EXPECT_EQ(r[6].status, process_status::crashed);
+    EXPECT_EQ(r[7].text, "FAILURE");
+    EXPECT_EQ(r[8].text, "OK");
+    EXPECT_EQ(runner.respawns(), 3u);
+}
+
+TEST(process_runner, arena_overflow) {
+    auto f = [](std::string text) { return machine_result{std::string(text.size() * 100, 'x'), 1}; };
+    std::vector<std::string_view> inputs = {"a", "aaaaaaaaaa", "b"};
+    process_runner runner{f, {1, std::chrono::milliseconds{10000}, 0, 512}};
+    std::vector<process_result> r = runner.run(inputs);
+    EXPECT_EQ(r[0].status, process_status::ok);
+    EXPECT_EQ(r[0].text, std::string(100, 'x'));
+    EXPECT_EQ(r[1].status, process_status::overflow);
+    EXPECT_EQ(r[2].status, process_status::ok);
+}
+
+}} // namespace nn
@@ -0,0 +1,69 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+
+namespace nn { namespace {
+
+TEST(rle_text, runs) {
+    rle_text t{"<111>aa"};
+    EXPECT_EQ(t.runs, (std::vector<rle_run>{{'<', 1}, {'1', 3}, {'>', 1}, {'a', 2}}));
+    EXPECT_EQ(t.size(), 7);
+    EXPECT_EQ(t.str(), "<111>aa");
+    EXPECT_TRUE(rle_text{}.empty());
+}
+
+template<Str auto s, Str auto r>
+void expect_same_substitution(std::string src) {
+    std::string expected = src;
+    bool expected_ok = try_substitute_inplace(ct<s>{}, ct<r>{}, expected);
+    rle_text t{src};
+    bool ok = try_substitute_inplace(ct<s>{}, ct<r>{}, t);
+    EXPECT_EQ(ok, expected_ok) << src;
+    EXPECT_EQ(t.str(), expected) << src;
+    EXPECT_EQ(t, rle_text{expected}) << src; // runs are still maximal
+}
+
+TEST(rle_text, substitute) {
+    for (std::string src : {"", "1", "c", "c1", "111c111", "c11c11", "1111111111e", "<:11e", "ab", "aabba"}) {
+        expect_same_substitution<STR(""), STR("")>(src);
+        expect_same_substitution<STR(""), STR("1")>(src);
+        expect_same_substitution<STR("1"), STR("")>(src);
+        expect_same_substitution<STR("c11"), STR("11c")>(src);
+        expect_same_substitution<STR("11e"), STR("e1")>(src);
+        expect_same_substitution<STR("1111111111e"), STR("e11111")>(src);
+        expect_same_substitution<STR(":e"), STR("")>(src);
+        expect_same_substitution<STR("c"), STR("cc")>(src);
+        expect_same_substitution<STR("ab"), STR("ba")>(src);
+        expect_same_substitution<STR("abb"), STR("a")>(src);
+        expect_same_substitution<STR("1c1"), STR("z")>(src);
+    }
+}
+
+constexpr auto halve = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>"),
+    RULE("1111111111e", "e11111"),
+    RULE("11e", "e1"),
+    RULE(":e", "")
+);
+
+TEST(rle_text, machine) {
+    constexpr auto m = MACHINE(halve);
+    for (size_t n : {0, 1, 2, 10, 64, 100}) {
+        std::string src = "<" + std::string(n, '1') + ">";
+        rle_text dst = m(rle_text{src});
+        EXPECT_EQ(dst.str(), m(src)) << src;
+    }
+}
+
+TEST(rle_text, long_runs) {
+    constexpr auto m = MACHINE_FROM_RULE((rule_loop<halve, rule_loop_unlimited_v>{}));
+    const size_t n = 1 << 16;
+    rle_text dst = m(rle_text{"<" + std::string(n, '1') + ">"});
+    // halving 2^16 down to 1, the text never has more than a handful of runs
+    EXPECT_EQ(dst.str(), "<1>");
+    EXPECT_EQ(dst.runs.size(), 3);
+}
+
+} } // namespace nn
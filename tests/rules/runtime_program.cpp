@@ -0,0 +1,84 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <random>
+#include <string>
+
+namespace nn { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE"),
+    FINAL_RULE("", "OK")
+);
+
+constexpr char brackets_source[] = R"(
+# correct bracket sequence
+()   -> ""
+(    -> _
+)    -> _
+__   -> _
+_    ->. FAILURE
+""   ->. OK
+)";
+
+TEST(runtime_program, parse) {
+    runtime_program p = runtime_program::parse(brackets_source);
+    ASSERT_EQ(p.rules().size(), 6u);
+    EXPECT_EQ(p.rules()[0], (runtime_rule{"()", "", false}));
+    EXPECT_EQ(p.rules()[4], (runtime_rule{"_", "FAILURE", true}));
+    EXPECT_EQ(p.rules()[5], (runtime_rule{"", "OK", true}));
+
+    runtime_program q = runtime_program::parse(
+        "\"a b\" -> \"\\t\\x41\\\"\" # comment\n"
+        "-> x\n"
+        "y ->\n"
+        "\"#\" ->. \"->\"\n");
+    ASSERT_EQ(q.rules().size(), 4u);
+    EXPECT_EQ(q.rules()[0], (runtime_rule{"a b", "\tA\"", false}));
+    EXPECT_EQ(q.rules()[1], (runtime_rule{"", "x", false}));
+    EXPECT_EQ(q.rules()[2], (runtime_rule{"y", "", false}));
+    EXPECT_EQ(q.rules()[3], (runtime_rule{"#", "->", true}));
+}
+
+TEST(runtime_program, parse_errors) {
+    EXPECT_THROW(runtime_program::parse("a b\n"), std::invalid_argument);
+    EXPECT_THROW(runtime_program::parse("a -> b -> c\n"), std::invalid_argument);
+    EXPECT_THROW(runtime_program::parse("a b -> c\n"), std::invalid_argument);
+    EXPECT_THROW(runtime_program::parse("\"a -> b\n"), std::invalid_argument);
+    EXPECT_THROW(runtime_program::parse("\"\\q\" -> b\n"), std::invalid_argument);
+    try {
+        runtime_program::parse("a -> b\n\nc\n");
+        FAIL();
+    } catch (std::invalid_argument const& e) {
+        EXPECT_EQ(std::string(e.what()).substr(0, 7), "line 3:");
+    }
+}
+
+TEST(runtime_program, same_as_compiled) {
+    constexpr auto m = MACHINE(brackets);
+    runtime_program p = runtime_program::parse(brackets_source);
+    std::mt19937 rng{7};
+    for (size_t i = 0; i != 300; ++i) {
+        std::string s;
+        for (size_t n = rng() % 30; n != 0; --n)
+            s.push_back(rng() % 2 ? '(' : ')');
+        machine_result r = p.run(s);
+        EXPECT_EQ(r.text, m(s)) << s;
+        machine_state<std::string> c = run_interruptible<brackets>(
+            machine_state<std::string>{s, 0, rule_loop_limit_v}, std::stop_token{});
+        EXPECT_EQ(r.steps, c.steps) << s;
+    }
+}
+
+TEST(runtime_program, limit) {
+    runtime_program p{{{"a", "bb"}}};
+    EXPECT_EQ(p.run("aaaaa", 3), (machine_result{"bbbbbbaa", 3}));
+    EXPECT_EQ(p.run("aaaaa"), (machine_result{std::string(10, 'b'), 5}));
+    EXPECT_EQ(p.run("ccc"), (machine_result{"ccc", 0}));
+}
+
+}} // namespace nn
@@ -0,0 +1,202 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+constexpr auto machine = MACHINE(collatz);
+constexpr auto marker = MACHINE(RULES(RULE("a", "b")));
+
+// texts after every step
+std::vector<std::string> history(std::string src) {
+    std::vector<std::string> texts;
+    machine(inplace_augmented_text{src, inplace_side_effect{[&](auto, std::string const& t) { texts.push_back(t); }}});
+    return texts;
+}
+
+step_sampler run(std::string src, sampling_options options) {
+    step_sampler s{options};
+    auto dst = machine(inplace_augmented_text{src, inplace_sampling_tracer{&s}});
+    EXPECT_EQ(dst.text, machine(src));
+    return s;
+}
+
+void expect_snippets(std::vector<step_sample> const& samples, std::vector<std::string> const& texts, size_t radius) {
+    for (step_sample const& s : samples) {
+        ASSERT_LE(s.step, texts.size());
+        std::string const& t = texts[s.step - 1];
+        EXPECT_EQ(s.size, t.size());
+        ASSERT_NE(s.pos, step_sample::unknown_pos);
+        ASSERT_GE(s.pos, s.offset);
+        EXPECT_EQ(s.snippet, t.substr(s.pos - s.offset, s.snippet.size())) << s.step;
+        EXPECT_LE(s.offset, radius);
+        EXPECT_LE(s.snippet.size(), 4 * radius);
+    }
+}
+
+TEST(step_sampler, every_nth) {
+    std::string src = "<111111111>";
+    auto texts = history(src);
+    step_sampler s = run(src, {.mode = sampling_mode::every_nth, .capacity = 1000, .every = 10, .radius = 4});
+    EXPECT_EQ(s.steps(), texts.size());
+    auto samples = s.samples();
+    // a walk is taken as a whole, so its last step may be past the multiple
+    EXPECT_GE(samples.size(), texts.size() / 10 / 2);
+    EXPECT_LE(samples.size(), texts.size() / 10);
+    for (size_t i = 1; i < samples.size(); ++i)
+        EXPECT_GE(samples[i].step / 10, samples[i - 1].step / 10 + 1);
+    expect_snippets(samples, texts, 4);
+}
+
+TEST(step_sampler, bounded) {
+    std::string src = "<111111111111111111111111111>";
+    auto texts = history(src);
+    step_sampler s = run(src, {.mode = sampling_mode::every_nth, .capacity = 8, .every = 1});
+    EXPECT_EQ(s.steps(), texts.size());
+    auto samples = s.samples();
+    EXPECT_LE(samples.size(), 8u);
+    EXPECT_GE(samples.size(), 3u);
+    EXPECT_GE(s.stride(), texts.size() / 16);
+    // evenly over the whole run
+    EXPECT_GE(samples.back().step + 2 * s.stride(), texts.size());
+    EXPECT_LE(samples.front().step, 2 * s.stride());
+    expect_snippets(samples, texts, 16);
+}
+
+TEST(step_sampler, reservoir) {
+    std::string src(2000, 'a');
+    double sum = 0;
+    size_t n = 0;
+    for (uint64_t seed = 1; seed <= 200; ++seed) {
+        step_sampler s{{.mode = sampling_mode::reservoir, .capacity = 10, .seed = seed}};
+        marker(inplace_augmented_text{src, inplace_sampling_tracer{&s}});
+        EXPECT_EQ(s.steps(), 2000u);
+        auto samples = s.samples();
+        ASSERT_EQ(samples.size(), 10u);
+        std::set<uint64_t> steps;
+        for (step_sample const& sample : samples) {
+            steps.insert(sample.step);
+            // the step k replaced the k-th 'a'
+            EXPECT_EQ(sample.pos, sample.step - 1);
+            sum += static_cast<double>(sample.step);
+            ++n;
+        }
+        EXPECT_EQ(steps.size(), 10u);
+    }
+    // uniform over 1..2000
+    EXPECT_NEAR(sum / static_cast<double>(n), 1000.5, 80);
+
+    // fewer steps than the capacity: all of them
+    step_sampler all{{.mode = sampling_mode::reservoir, .capacity = 100}};
+    marker(inplace_augmented_text{std::string("aaa"), inplace_sampling_tracer{&all}});
+    EXPECT_EQ(all.samples().size(), 3u);
+
+    // the same seed, the same samples
+    std::string collatz_src = "<111111111>";
+    auto a = run(collatz_src, {.mode = sampling_mode::reservoir, .capacity = 16, .seed = 7});
+    auto b = run(collatz_src, {.mode = sampling_mode::reservoir, .capacity = 16, .seed = 7});
+    std::vector<uint64_t> sa, sb;
+    for (auto const& x : a.samples())
+        sa.push_back(x.step);
+    for (auto const& x : b.samples())
+        sb.push_back(x.step);
+    EXPECT_EQ(sa, sb);
+    expect_snippets(a.samples(), history(collatz_src), 16);
+}
+
+TEST(step_sampler, interval) {
+    std::string src = "<111111111>";
+    auto texts = history(src);
+    // the first step only
+    step_sampler once = run(src, {.mode = sampling_mode::interval, .interval = std::chrono::hours{1}});
+    ASSERT_EQ(once.samples().size(), 1u);
+    EXPECT_EQ(once.samples()[0].step, once.samples()[0].count);
+
+    // as often as possible: bounded by thinning out
+    step_sampler often = run(src, {.mode = sampling_mode::interval, .capacity = 8, .interval = std::chrono::nanoseconds{1}});
+    EXPECT_EQ(often.steps(), texts.size());
+    EXPECT_LE(often.samples().size(), 8u);
+    EXPECT_GT(often.stride(), 1u);
+    auto samples = often.samples();
+    for (size_t i = 1; i < samples.size(); ++i)
+        EXPECT_LE(samples[i - 1].time_ns, samples[i].time_ns);
+    expect_snippets(samples, texts, 16);
+}
+
+TEST(step_sampler, summary_and_report) {
+    std::string src = "<111111111>";
+    step_sampler s = run(src, {.mode = sampling_mode::every_nth, .capacity = 1000, .every = 1, .radius = 3});
+    sampling_summary sum = s.summary();
+    EXPECT_EQ(sum.steps, s.steps());
+    EXPECT_EQ(sum.samples, s.samples().size());
+    double shares = 0;
+    uint64_t samples = 0;
+    for (size_t i = 0; i != sum.rules.size(); ++i) {
+        shares += sum.rules[i].share;
+        samples += sum.rules[i].samples;
+        if (i != 0) {
+            EXPECT_GE(sum.rules[i - 1].samples, sum.rules[i].samples);
+        }
+    }
+    EXPECT_DOUBLE_EQ(shares, 1.0);
+    EXPECT_EQ(samples, sum.samples);
+    EXPECT_LE(sum.min_size, sum.max_size);
+    EXPECT_GE(sum.mean_size, static_cast<double>(sum.min_size));
+
+    std::string report = s.report();
+    EXPECT_NE(report.find("steps=" + std::to_string(s.steps())), std::string::npos);
+    EXPECT_NE(report.find("stop\tsamples=1 "), std::string::npos);
+    EXPECT_NE(report.find("\t[<:11c]111\n"), std::string::npos) << report;
+
+    EXPECT_EQ(step_sampler{}.summary().samples, 0u);
+
+    // steps reported without their edits: the head of the text
+    constexpr auto nested = MACHINE(RULES(FACADE_RULE("f", RULE_LOOP(RULE("ab", "b"))), RULE("b", "cc")));
+    step_sampler unknown{{.every = 1, .radius = 1}};
+    nested(inplace_augmented_text{std::string("aabx"), inplace_sampling_tracer{&unknown}});
+    ASSERT_EQ(unknown.samples().size(), 1u);
+    EXPECT_EQ(unknown.samples()[0].pos, step_sample::unknown_pos);
+    EXPECT_EQ(unknown.samples()[0].snippet, "bx");
+    EXPECT_NE(unknown.report().find("\t-\t2\t1\t[]bx\n"), std::string::npos) << unknown.report();
+}
+
+TEST(step_sampler, overhead) {
+    std::string src = "<111111111111111>";
+    size_t reps = 5;
+    std::ostringstream printed;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != reps; ++i)
+        machine(inplace_augmented_text{src, inplace_side_effect{[&](auto p, std::string const& t) {
+            printed << p << '\t' << t << '\n';
+        }}});
+    double printing_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    step_sampler s{{.capacity = 256, .every = 100}};
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != reps; ++i)
+        machine(inplace_augmented_text{src, inplace_sampling_tracer{&s}});
+    double sampling_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_LE(s.samples().size(), 256u);
+
+    std::cout << "ns per step: printing " << printing_ns / static_cast<double>(s.steps())
+              << ", sampling " << sampling_ns / static_cast<double>(s.steps()) << "\n";
+}
+
+}} // namespace nn
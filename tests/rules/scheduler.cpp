@@ -0,0 +1,71 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <future>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE"),
+    FINAL_RULE("", "OK")
+);
+
+TEST(machine_task, slices) {
+    constexpr auto m = MACHINE(brackets);
+    std::string src = "((()())";
+    machine_task<brackets> task{src};
+    size_t resumes = 0;
+    while (!task.resume(2)) {
+        ++resumes;
+        EXPECT_EQ(task.steps(), resumes * 2);
+    }
+    EXPECT_EQ(task.text(), m(src));
+    EXPECT_TRUE(task.done());
+    EXPECT_TRUE(task.resume(2)); // stays done
+    machine_result r = std::move(task).take();
+    EXPECT_EQ(r.text, m(src));
+    EXPECT_EQ(r.steps, 5);
+}
+
+TEST(machine_task, limit) {
+    machine_task<brackets, 3> task{"(((((("};
+    while (!task.resume(1)) {}
+    EXPECT_EQ(task.steps(), 3);
+    EXPECT_EQ(task.text(), "___(((");
+}
+
+// endless cycle of cheap steps, cut by the limit
+constexpr auto cycle = RULES(RULE("a", "b"), RULE("b", "c"), RULE("c", "a"));
+
+TEST(scheduler, results) {
+    constexpr auto m = MACHINE(brackets);
+    scheduler s{3, 4};
+    std::vector<std::string> srcs = {"", "()", "((", "(()())", "(((((((((())))))))))", ")("};
+    std::vector<std::future<machine_result>> fs;
+    for (auto const& src : srcs)
+        fs.push_back(s.submit(machine_task<brackets>{src}));
+    for (size_t i = 0; i != srcs.size(); ++i)
+        EXPECT_EQ(fs[i].get().text, m(srcs[i]));
+}
+
+TEST(scheduler, long_task_does_not_block) {
+    scheduler s{1, 16}; // a single worker
+    auto long_one = s.submit(machine_task<cycle, 2000000>{"a"});
+    std::vector<std::future<machine_result>> short_ones;
+    for (size_t i = 0; i != 10; ++i)
+        short_ones.push_back(s.submit(machine_task<brackets>{"(())"}));
+    for (auto& f : short_ones)
+        EXPECT_EQ(f.get().text, "OK");
+    EXPECT_EQ(long_one.wait_for(std::chrono::seconds{0}), std::future_status::timeout);
+    machine_result r = long_one.get();
+    EXPECT_EQ(r.steps, 2000000);
+    EXPECT_EQ(r.text, "c"); // 2000000 % 3 == 2
+}
+
+} } // namespace nn
@@ -0,0 +1,138 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+constexpr auto machine = MACHINE(collatz);
+
+TEST(log_linear_histogram, buckets) {
+    using h = latency_histogram;
+    for (uint64_t v = 0; v != 16; ++v)
+        EXPECT_EQ(h::upper_of(h::bucket_of(v)), v);
+    // every value lies in its bucket, within the relative precision
+    std::mt19937_64 rng{1};
+    for (size_t i = 0; i != 10000; ++i) {
+        uint64_t v = rng() >> (rng() % 64);
+        size_t b = h::bucket_of(v);
+        ASSERT_LT(b, h::buckets);
+        uint64_t upper = h::upper_of(b);
+        ASSERT_GE(upper, v);
+        ASSERT_LE(upper - v, v / 16 + 1) << v;
+        if (b != 0)
+            ASSERT_LT(h::upper_of(b - 1), v);
+    }
+    EXPECT_EQ(h::bucket_of(~uint64_t{0}), h::buckets - 1);
+    EXPECT_EQ(h::upper_of(h::buckets - 1), ~uint64_t{0});
+}
+
+TEST(log_linear_histogram, percentiles_and_merge) {
+    latency_histogram a, b;
+    for (uint64_t v = 1; v <= 1000; ++v)
+        (v % 2 ? a : b).record(v * 1000);
+    latency_histogram m = a;
+    m.merge(b);
+    EXPECT_EQ(m.count(), 1000u);
+    EXPECT_EQ(m.min(), 1000u);
+    EXPECT_EQ(m.max(), 1000000u);
+    EXPECT_DOUBLE_EQ(m.mean(), 500500.0);
+    auto near = [](uint64_t got, uint64_t expected) {
+        return got >= expected && got - expected <= expected / 16 + 1;
+    };
+    EXPECT_PRED2(near, m.percentile(0.5), 500000u);
+    EXPECT_PRED2(near, m.percentile(0.99), 990000u);
+    EXPECT_EQ(m.percentile(1.0), 1000000u);
+    EXPECT_PRED2(near, m.percentile(0.0), 1000u);
+
+    latency_histogram empty;
+    EXPECT_EQ(empty.percentile(0.5), 0u);
+    m.merge(empty);
+    EXPECT_EQ(m.count(), 1000u);
+}
+
+TEST(inplace_step_latency, counts_steps_by_rule) {
+    std::string src = "<1111111>";
+    size_t steps = 0;
+    std::map<std::string, size_t> by_name;
+    machine(inplace_augmented_text{src, inplace_side_effect{[&](auto p, std::string const&) {
+        std::ostringstream ss;
+        ss << p;
+        ++by_name[ss.str()];
+        ++steps;
+    }}});
+
+    step_latencies lat;
+    auto dst = machine(inplace_augmented_text{src, inplace_step_latency{&lat}});
+    EXPECT_EQ(dst.text, machine(src));
+    EXPECT_EQ(lat.all.count(), steps);
+    size_t total = 0;
+    for (size_t i = 0; i != lat.by_rule.size(); ++i) {
+        if (lat.by_rule[i].count() == 0)
+            continue;
+        EXPECT_EQ(lat.by_rule[i].count(), by_name[inplace_rule_name(static_cast<uint32_t>(i))]);
+        total += lat.by_rule[i].count();
+    }
+    EXPECT_EQ(total, steps);
+    EXPECT_EQ(lat.of_rule(inplace_rule_id(collatz)).count(), 0u); // the program itself doesn't report
+    EXPECT_NE(lat.report().find("stop\tcount=1 "), std::string::npos);
+}
+
+TEST(inplace_step_latency, merge_threads) {
+    std::vector<std::string> texts = {"<11>", "<111>", "<11111>", "<1111111>"};
+    std::vector<step_latencies> per_thread(texts.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != texts.size(); ++i)
+        threads.emplace_back([&, i] { machine(inplace_augmented_text{texts[i], inplace_step_latency{&per_thread[i]}}); });
+    for (auto& t : threads)
+        t.join();
+
+    step_latencies sum;
+    size_t expected = 0;
+    for (auto const& l : per_thread) {
+        sum.merge(l);
+        expected += l.all.count();
+    }
+    EXPECT_EQ(sum.all.count(), expected);
+    EXPECT_LE(sum.all.percentile(0.5), sum.all.percentile(0.999));
+    EXPECT_LE(sum.all.percentile(0.999), sum.all.max());
+}
+
+TEST(inplace_step_latency, overhead) {
+    std::string src = "<111111111>";
+    size_t reps = 20, steps = 0;
+    auto count = [](size_t n, auto, std::string const&) { return n + 1; };
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != reps; ++i)
+        steps += machine(inplace_augmented_text{src, inplace_cumulative_effect{size_t{0}, count}}).aux.a;
+    double counter_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    step_latencies lat;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != reps; ++i)
+        machine(inplace_augmented_text{src, inplace_step_latency{&lat}});
+    double latency_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(lat.all.count(), steps);
+
+    std::cout << "ns per step: counter " << counter_ns / steps << ", latency histograms " << latency_ns / steps
+              << "\n" << lat.report();
+}
+
+}} // namespace nn
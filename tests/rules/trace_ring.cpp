@@ -0,0 +1,175 @@
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+constexpr auto machine = MACHINE(collatz);
+
+TEST(spsc_ring, fifo) {
+    spsc_ring<int> ring{5};
+    EXPECT_EQ(ring.capacity(), 8u);
+    std::vector<int> out(16);
+    EXPECT_EQ(ring.pop(out), 0u);
+    for (int i = 0; i != 6; ++i)
+        EXPECT_TRUE(ring.push(i));
+    EXPECT_EQ(ring.pop(std::span{out}.first(4)), 4u);
+    EXPECT_EQ(out[3], 3);
+    for (int i = 6; i != 12; ++i)
+        EXPECT_TRUE(ring.push(i));
+    ASSERT_EQ(ring.pop(out), 8u);
+    for (int i = 0; i != 8; ++i)
+        EXPECT_EQ(out[i], i + 4);
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(spsc_ring, overflow_policies) {
+    std::vector<int> out(16);
+
+    spsc_ring<int> drops{4, ring_overflow::count_drops};
+    for (int i = 0; i != 10; ++i)
+        drops.push(i);
+    EXPECT_EQ(drops.dropped(), 6u);
+    ASSERT_EQ(drops.pop(out), 4u);
+    EXPECT_EQ(out[0], 0); // the newest were dropped
+    EXPECT_EQ(out[3], 3);
+
+    spsc_ring<int> oldest{4, ring_overflow::drop_oldest};
+    for (int i = 0; i != 10; ++i)
+        EXPECT_TRUE(oldest.push(i));
+    EXPECT_EQ(oldest.dropped(), 6u);
+    ASSERT_EQ(oldest.pop(out), 4u);
+    EXPECT_EQ(out[0], 6); // the oldest were dropped
+    EXPECT_EQ(out[3], 9);
+}
+
+TEST(spsc_ring, threads) {
+    constexpr size_t n = 20000;
+    for (ring_overflow policy : {ring_overflow::block, ring_overflow::drop_oldest, ring_overflow::count_drops}) {
+        spsc_ring<size_t> ring{64, policy};
+        std::vector<size_t> seen;
+        std::thread consumer{[&] {
+            std::vector<size_t> out(16);
+            while (true) {
+                size_t k = ring.pop(out);
+                for (size_t i = 0; i != k; ++i)
+                    seen.push_back(out[i]);
+                if (k != 0 && seen.back() == n - 1)
+                    break;
+                if (k == 0 && ring.dropped() != 0 && seen.size() + ring.dropped() == n)
+                    break;
+            }
+        }};
+        for (size_t i = 0; i != n; ++i)
+            ring.push(i);
+        consumer.join();
+
+        // events come in order, without duplicates, and every one is either seen or dropped
+        for (size_t i = 1; i < seen.size(); ++i)
+            ASSERT_LT(seen[i - 1], seen[i]);
+        EXPECT_EQ(seen.size() + ring.dropped(), n);
+        if (policy == ring_overflow::block)
+            EXPECT_EQ(ring.dropped(), 0u);
+    }
+}
+
+TEST(inplace_ring_tracer, events) {
+    std::string src = "<1111111>";
+    std::vector<std::string> rules;
+    std::vector<size_t> sizes;
+    machine(inplace_augmented_text{src, inplace_side_effect{[&](auto p, std::string const& t) {
+        std::ostringstream ss;
+        ss << p;
+        rules.push_back(ss.str());
+        sizes.push_back(t.size());
+    }}});
+
+    trace_ring ring{16};
+    std::vector<trace_event> events;
+    {
+        trace_consumer consumer{ring, [&](std::span<trace_event const> batch) {
+            events.insert(events.end(), batch.begin(), batch.end());
+        }, 4};
+        auto dst = machine(inplace_augmented_text{src, inplace_ring_tracer{&ring}});
+        EXPECT_EQ(dst.aux.step, rules.size());
+    } // drained on destruction
+
+    // a marker walk comes as a single bulk event of its steps
+    size_t step = 0;
+    for (size_t i = 0; i != events.size(); ++i) {
+        ASSERT_GE(events[i].count, 1u);
+        for (size_t k = 0; k != events[i].count; ++k)
+            EXPECT_EQ(inplace_rule_name(events[i].rule), rules[step + k]) << step + k;
+        step += events[i].count;
+        EXPECT_EQ(events[i].step, step);
+        EXPECT_EQ(events[i].size, sizes[step - 1]);
+        if (i != 0)
+            EXPECT_LE(events[i - 1].time_ns, events[i].time_ns);
+    }
+    EXPECT_EQ(step, rules.size());
+    EXPECT_EQ(ring.dropped(), 0u);
+
+    std::ostringstream os;
+    trace_text_sink{&os}(std::span{events}.first(1));
+    EXPECT_EQ(os.str().substr(0, 2), "1\t");
+}
+
+TEST(inplace_ring_tracer, overhead) {
+    std::string src = "<" + std::string(9, '1') + ">";
+    size_t reps = 20;
+    auto time = [&](auto aux) {
+        auto start = std::chrono::steady_clock::now();
+        size_t steps = 0;
+        for (size_t i = 0; i != reps; ++i)
+            steps += machine(inplace_augmented_text{src, aux}).aux.a;
+        return std::pair{std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count(), steps};
+    };
+    auto count = [](size_t n, auto, std::string const&) { return n + 1; };
+    auto [plain_ns, steps] = time(inplace_cumulative_effect{size_t{0}, count});
+
+    trace_ring ring{1 << 16, ring_overflow::count_drops};
+    size_t sunk = 0;
+    double ring_ns;
+    {
+        trace_consumer consumer{ring, [&](std::span<trace_event const> b) {
+            for (trace_event const& e : b)
+                sunk += e.count;
+        }};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i != reps; ++i)
+            machine(inplace_augmented_text{src, inplace_ring_tracer{&ring}});
+        ring_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    EXPECT_EQ(sunk + ring.dropped(), steps);
+
+    std::ostringstream sink;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != reps; ++i)
+        machine(inplace_augmented_text{src, inplace_side_effect{[&](auto p, std::string const& t) {
+            sink << p << '\t' << t << '\n';
+        }}});
+    double print_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "ns per step: counter " << plain_ns / steps
+              << ", ring tracer " << ring_ns / steps
+              << ", formatting side effect " << print_ns / steps
+              << " (" << steps << " steps, " << ring.dropped() << " dropped)" << std::endl;
+}
+
+}} // namespace nn
@@ -0,0 +1,79 @@
+#define NENORMAL_USDT 1 // regardless of the cmake option
+#include "nenormal/nenormal.h"
+#include <gtest/gtest.h>
+#include "../utils.h"
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace nn { namespace {
+
+constexpr auto collatz = RULES(
+    RULE("<11", "<:11c"),
+    RULE("c11", "11c"),
+    RULE("c>", "e>2"),
+    RULE("11e", "e1"),
+    RULE(":e", ""),
+    RULE("c1>", "o1111>3"),
+    RULE("1o", "o111"),
+    RULE(":o", ""),
+    FACADE_RULE("stop", FINAL_RULE("<1>", ""))
+);
+constexpr auto machine = MACHINE(collatz);
+// loops cannot be flattened: the outer one goes through rule::update
+constexpr auto nested_machine = MACHINE(RULES(RULE_LOOP(RULE("ab", "b")), FINAL_RULE("b", "ok")));
+
+#if NN_USDT_ENABLED
+
+std::string self_image() {
+    std::ifstream f{"/proc/self/exe", std::ios::binary};
+    return {std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+}
+
+TEST(usdt, notes_are_compiled_in) {
+    std::string image = self_image();
+    ASSERT_FALSE(image.empty());
+    EXPECT_NE(image.find(std::string("stapsdt\0", 8)), std::string::npos);
+    for (std::string name : {"machine_start", "machine_end", "loop_iteration", "rule_match", "rule_miss", "substitute"})
+        EXPECT_NE(image.find(std::string("nenormal") + '\0' + name + '\0'), std::string::npos) << name;
+    // names of the rules are the printed ones
+    EXPECT_NE(image.find("(\"<11\" -> \"<:11c\")"), std::string::npos);
+}
+
+TEST(usdt, same_results_when_attached) {
+    std::string src = "<1111111>";
+    std::string expected = machine(src);
+    std::string nested_expected = nested_machine(std::string("aab"));
+    runtime_program rp = runtime_program::parse("ab -> b\nb ->. ok\n");
+    machine_result rp_expected = rp.run("aab");
+
+    // as if a tracer attached to every probe
+    volatile unsigned short* semaphores[] = {
+        &nenormal_machine_start_semaphore, &nenormal_machine_end_semaphore, &nenormal_loop_iteration_semaphore,
+        &nenormal_rule_match_semaphore, &nenormal_rule_miss_semaphore, &nenormal_substitute_semaphore,
+    };
+    for (auto s : semaphores)
+        EXPECT_EQ(*s, 0);
+    EXPECT_FALSE(NN_PROBE_ENABLED(rule_match));
+    for (auto s : semaphores)
+        *s = 1;
+    EXPECT_TRUE(NN_PROBE_ENABLED(rule_match));
+
+    EXPECT_EQ(machine(src), expected);
+    EXPECT_EQ(machine(src, std::stop_token{}).text, expected);
+    EXPECT_EQ(nested_machine(std::string("aab")), nested_expected);
+    EXPECT_EQ(rp.run("aab"), rp_expected);
+
+    for (auto s : semaphores)
+        *s = 0;
+}
+
+#else
+
+TEST(usdt, notes_are_compiled_in) {
+    GTEST_SKIP() << "no usdt probes on this platform";
+}
+
+#endif
+
+}} // namespace nn
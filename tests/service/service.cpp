@@ -0,0 +1,147 @@
+#include "nenormal/nenormal.h"
+#include "nenormal/service/client.h"
+#include "nenormal/service/server.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace nn::service { namespace {
+
+constexpr auto brackets = RULES(
+    RULE("()", ""),
+    RULE("(", "_"),
+    RULE(")", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "FAILURE"),
+    FINAL_RULE("", "OK")
+);
+
+constexpr auto doubling = RULES(
+    RULE("a", "bb")
+);
+
+std::string temp_socket(char const* name) {
+    return "/tmp/nenormal_test_" + std::to_string(::getpid()) + "_" + name + ".sock";
+}
+
+TEST(protocol, round_trip) {
+    std::string out;
+    put_request(out, {'Q', 300, "brackets", std::string("(\0)", 3)});
+    put_request(out, {'S', 7, {}, {}});
+    put_response(out, {300, status::unknown_program, 12345, 67, "text"});
+
+    std::string_view in = out;
+    auto next = [&] {
+        size_t n = static_cast<unsigned char>(in[0]) | static_cast<unsigned char>(in[1]) << 8 |
+                   static_cast<unsigned char>(in[2]) << 16 | static_cast<unsigned char>(in[3]) << 24;
+        std::string_view payload = in.substr(4, n);
+        in.remove_prefix(4 + n);
+        return payload;
+    };
+    request q = get_request(next());
+    EXPECT_EQ(q.kind, 'Q');
+    EXPECT_EQ(q.id, 300u);
+    EXPECT_EQ(q.program, "brackets");
+    EXPECT_EQ(q.text, std::string("(\0)", 3));
+    request s = get_request(next());
+    EXPECT_EQ(s.kind, 'S');
+    EXPECT_EQ(s.id, 7u);
+    EXPECT_EQ(get_response(next()), (response{300, status::unknown_program, 12345, 67, "text"}));
+    EXPECT_TRUE(in.empty());
+
+    EXPECT_THROW(get_request("X"), std::runtime_error);
+}
+
+TEST(registry, names_and_fingerprints) {
+    program_registry registry;
+    registry.add<brackets>("brackets");
+    registry.add<doubling, 3>("doubling");
+    EXPECT_THROW(registry.add<brackets>("brackets"), std::invalid_argument);
+
+    auto const* run = registry.find("brackets");
+    ASSERT_NE(run, nullptr);
+    EXPECT_EQ((*run)("(()").text, "FAILURE");
+    EXPECT_EQ((*run)("(())").text, "OK");
+    EXPECT_EQ(registry.find("nothing"), nullptr);
+
+    // the limit of the loop holds
+    machine_result r = (*registry.find("doubling"))("aaaaa");
+    EXPECT_EQ(r.steps, 3u);
+    EXPECT_EQ(r.text, "bbbbbbaa");
+
+    auto key = program_registry::fingerprint_key(rule_fingerprint_v<rule_loop_v<brackets, rule_loop_limit_v>>);
+    ASSERT_NE(registry.find(key), nullptr);
+    EXPECT_EQ((*registry.find(key))("()").text, "OK");
+    EXPECT_EQ(registry.keys().size(), 4u);
+}
+
+TEST(server, call) {
+    program_registry registry;
+    registry.add<brackets>("brackets");
+    unix_server server{temp_socket("call"), registry, {2, 8, std::chrono::microseconds{0}}};
+
+    unix_client client{server.path()};
+    response r = client.call("brackets", "(()())");
+    EXPECT_EQ(r.status, status::ok);
+    EXPECT_EQ(r.text, "OK");
+    EXPECT_EQ(r.steps, 4u);
+
+    r = client.call("unknown", "()");
+    EXPECT_EQ(r.status, status::unknown_program);
+    EXPECT_EQ(r.text, "unknown");
+
+    EXPECT_EQ(server.stats().requests, 2u);
+    EXPECT_NE(client.stats().find("requests=2"), std::string::npos);
+}
+
+TEST(server, pipelined_connections) {
+    program_registry registry;
+    registry.add<brackets>("brackets");
+    unix_server server{temp_socket("pipelined"), registry, {3, 16, std::chrono::microseconds{200}}};
+
+    constexpr auto m = MACHINE(brackets);
+    constexpr size_t connections = 4, requests = 200;
+    std::vector<std::thread> threads;
+    std::vector<size_t> failures(connections);
+    for (size_t c = 0; c != connections; ++c)
+        threads.emplace_back([&, c] {
+            unix_client client{server.path()};
+            std::vector<std::string> texts;
+            for (size_t i = 0; i != requests; ++i)
+                texts.push_back(std::string(i % 7, '(') + std::string((i + c) % 7, ')'));
+            uint64_t first = client.send_all("brackets", texts);
+            std::set<uint64_t> seen;
+            for (size_t i = 0; i != requests; ++i) {
+                response r = client.receive();
+                size_t k = r.id - first;
+                if (k >= requests || !seen.insert(r.id).second || r.text != m(texts[k]))
+                    ++failures[c];
+            }
+        });
+    for (auto& t : threads)
+        t.join();
+    for (size_t c = 0; c != connections; ++c)
+        EXPECT_EQ(failures[c], 0u);
+
+    server_stats s = server.stats();
+    EXPECT_EQ(s.requests, connections * requests);
+    EXPECT_LT(s.batches, s.requests); // requests are coalesced
+    EXPECT_LE(s.queue_us_p50, s.queue_us_p99);
+    EXPECT_LE(s.queue_us_total / s.requests, s.queue_us_max);
+}
+
+TEST(server, stop_with_open_connections) {
+    program_registry registry;
+    registry.add<brackets>("brackets");
+    auto server = std::make_unique<unix_server>(temp_socket("stop"), registry);
+    unix_client client{server->path()};
+    EXPECT_EQ(client.call("brackets", "()").text, "OK");
+    server.reset(); // must not hang on the idle connection
+    EXPECT_THROW(client.receive(), std::exception);
+}
+
+}} // namespace nn::service
@@ -0,0 +1,170 @@
+// nenormal-load: loopback load generator for nenormal-server
+//
+//   nenormal_load [options]
+//     --socket PATH      server socket (default /tmp/nenormal.sock)
+//     --embedded         start the server in this process (at PATH)
+//     --program NAME     brackets | increment (default brackets)
+//     --connections N    concurrent connections (default 4)
+//     --requests N       requests per connection (default 10000)
+//     --depth N          requests in flight per connection (default 16)
+//     --size N           size of a text (default 64)
+//
+// prints throughput, latency percentiles (send to receive) and the statistics of the server.
+
+#include "programs.h"
+#include "nenormal/service/client.h"
+#include "nenormal/service/server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    std::string socket = "/tmp/nenormal.sock";
+    bool embedded = false;
+    std::string program = "brackets";
+    size_t connections = 4;
+    size_t requests = 10000;
+    size_t depth = 16;
+    size_t size = 64;
+};
+
+options parse(int argc, char** argv) {
+    options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 == argc)
+                throw std::invalid_argument("missing value of " + a);
+            return argv[++i];
+        };
+        if (a == "--socket") o.socket = value();
+        else if (a == "--embedded") o.embedded = true;
+        else if (a == "--program") o.program = value();
+        else if (a == "--connections") o.connections = std::stoul(value());
+        else if (a == "--requests") o.requests = std::stoul(value());
+        else if (a == "--depth") o.depth = std::max<size_t>(std::stoul(value()), 1);
+        else if (a == "--size") o.size = std::stoul(value());
+        else throw std::invalid_argument("unknown option " + a);
+    }
+    return o;
+}
+
+std::string make_text(std::string const& program, size_t size, std::mt19937& rng) {
+    std::string s;
+    if (program == "increment") {
+        for (size_t i = 0; i != std::max<size_t>(size, 1); ++i)
+            s.push_back(rng() % 4 ? '1' : '0');
+        s.push_back('+');
+    } else {
+        static constexpr char open[] = "([{", close[] = ")]}";
+        std::vector<int> stack;
+        while (s.size() < size) {
+            if (!stack.empty() && (rng() % 2 || s.size() + stack.size() >= size)) {
+                s.push_back(close[stack.back()]);
+                stack.pop_back();
+            } else {
+                stack.push_back(static_cast<int>(rng() % 3));
+                s.push_back(open[stack.back()]);
+            }
+        }
+    }
+    return s;
+}
+
+struct connection_result {
+    std::vector<double> latencies_us;
+    size_t errors = 0;
+};
+
+connection_result drive(options const& o, unsigned seed) {
+    connection_result res;
+    res.latencies_us.reserve(o.requests);
+    std::mt19937 rng{seed};
+    std::vector<std::string> texts;
+    for (size_t i = 0; i != 64; ++i)
+        texts.push_back(make_text(o.program, o.size, rng));
+
+    nn::service::unix_client client{o.socket};
+    std::unordered_map<uint64_t, clock_type::time_point> sent;
+    size_t next = 0;
+    auto send_one = [&] {
+        sent[client.send(o.program, texts[next % texts.size()])] = clock_type::now();
+        ++next;
+    };
+    while (next != o.requests && sent.size() < o.depth)
+        send_one();
+    while (!sent.empty()) {
+        nn::service::response r = client.receive();
+        auto now = clock_type::now();
+        auto it = sent.find(r.id);
+        if (it != sent.end()) {
+            res.latencies_us.push_back(std::chrono::duration<double, std::micro>(now - it->second).count());
+            sent.erase(it);
+        }
+        if (r.status != nn::service::status::ok)
+            ++res.errors;
+        if (next != o.requests)
+            send_one();
+    }
+    return res;
+}
+
+double percentile(std::vector<double> const& sorted, double q) {
+    if (sorted.empty())
+        return 0;
+    return sorted[static_cast<size_t>(q * static_cast<double>(sorted.size() - 1))];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        options o = parse(argc, argv);
+
+        nn::service::program_registry registry;
+        std::unique_ptr<nn::service::unix_server> server;
+        if (o.embedded) {
+            tools::register_programs(registry);
+            server = std::make_unique<nn::service::unix_server>(o.socket, registry);
+        }
+
+        std::vector<connection_result> results(o.connections);
+        auto start = clock_type::now();
+        {
+            std::vector<std::jthread> threads;
+            for (size_t c = 0; c != o.connections; ++c)
+                threads.emplace_back([&, c] { results[c] = drive(o, static_cast<unsigned>(c + 1)); });
+        }
+        double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        std::vector<double> all;
+        size_t errors = 0;
+        for (auto& r : results) {
+            all.insert(all.end(), r.latencies_us.begin(), r.latencies_us.end());
+            errors += r.errors;
+        }
+        std::sort(all.begin(), all.end());
+
+        std::cout << "requests:   " << all.size() << " (" << errors << " errors)\n"
+                  << "throughput: " << static_cast<double>(all.size()) / seconds << " req/s\n"
+                  << "latency us: p50=" << percentile(all, 0.5)
+                  << " p99=" << percentile(all, 0.99)
+                  << " max=" << (all.empty() ? 0 : all.back()) << "\n"
+                  << "server:     " << nn::service::unix_client{o.socket}.stats() << std::endl;
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,271 @@
+// nenormal-run: runs a program over a stream of inputs
+//
+//   nenormal_run (--program NAME | --rules FILE) [options]
+//     --program NAME   compiled program: brackets | increment
+//     --rules FILE     runtime program from a rule file (see rules/runtime_program.h)
+//     --input FILE     read the inputs from the (mapped) file instead of stdin
+//     -0, --null       inputs and outputs are NUL-delimited instead of lines
+//     --limit N        limit of steps per input (default 5000, 0 - unlimited)
+//     --batch N        inputs run in parallel at a time (default 4096)
+//     --steps          append a tab and the number of steps to every output
+//     --timings        append a tab and the time of the run (us) to every output
+//     --summary        print inputs, steps, time and throughput to stderr
+//     --processes N    run the inputs on N forked worker processes instead of threads,
+//                      so a crash or a hang costs only its input (see parallel/process_runner.h);
+//                      the output of a failed input is "!timeout", "!crashed", "!error: ..." or "!overflow"
+//     --timeout MS     with --processes: time limit per input (default 10000)
+//     --memory MB      with --processes: address space limit of a worker
+//
+// inputs run in parallel on the thread pool; outputs keep the order of the inputs.
+
+#include "programs.h"
+#include "nenormal/parallel/process_runner.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using runner = std::function<nn::machine_result(std::string, size_t)>;
+
+template<nn::Rule auto p> nn::machine_result run_compiled(std::string text, size_t limit) {
+    auto s = nn::run_interruptible<p>(nn::machine_state<std::string>{std::move(text), 0, limit}, std::stop_token{});
+    return {std::move(s.text), s.steps};
+}
+
+std::map<std::string, runner> const compiled = {
+    {"brackets", run_compiled<tools::brackets>},
+    {"increment", run_compiled<tools::increment>},
+};
+
+struct options {
+    std::string program;
+    std::string rules;
+    std::string input;
+    char delimiter = '\n';
+    size_t limit = nn::rule_loop_limit_v;
+    size_t batch = 4096;
+    bool steps = false;
+    bool timings = false;
+    bool summary = false;
+    size_t processes = 0;
+    size_t timeout_ms = 10000;
+    size_t memory_mb = 0;
+};
+
+options parse(int argc, char** argv) {
+    options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 == argc)
+                throw std::invalid_argument("missing value of " + a);
+            return argv[++i];
+        };
+        if (a == "--program") o.program = value();
+        else if (a == "--rules") o.rules = value();
+        else if (a == "--input") o.input = value();
+        else if (a == "-0" || a == "--null") o.delimiter = '\0';
+        else if (a == "--limit") o.limit = std::stoul(value());
+        else if (a == "--batch") o.batch = std::max<size_t>(std::stoul(value()), 1);
+        else if (a == "--steps") o.steps = true;
+        else if (a == "--timings") o.timings = true;
+        else if (a == "--summary") o.summary = true;
+        else if (a == "--processes") o.processes = std::stoul(value());
+        else if (a == "--timeout") o.timeout_ms = std::stoul(value());
+        else if (a == "--memory") o.memory_mb = std::stoul(value());
+        else throw std::invalid_argument("unknown option " + a);
+    }
+    if (o.program.empty() == o.rules.empty())
+        throw std::invalid_argument("either --program or --rules is required");
+    if (o.processes != 0 && o.timings)
+        throw std::invalid_argument("--timings is not available with --processes");
+    if (o.limit == 0)
+        o.limit = std::numeric_limits<size_t>::max();
+    return o;
+}
+
+class runner_loop {
+public:
+    runner_loop(options const& o, runner run) : o_{o}, run_{std::move(run)} {
+        if (o_.processes != 0)
+            processes_.emplace(
+                [this](std::string text) { return run_(std::move(text), o_.limit); },
+                nn::process_runner_options{
+                    o_.processes, std::chrono::milliseconds{o_.timeout_ms}, o_.memory_mb << 20});
+    }
+
+    // runs a batch of inputs and writes the outputs in order
+    void process(std::vector<std::string_view> const& inputs) {
+        outputs_.resize(inputs.size());
+        steps_.assign(inputs.size(), 0);
+        if (processes_)
+            run_processes(inputs);
+        else
+            run_threads(inputs);
+        for (std::string const& out : outputs_)
+            std::fwrite(out.data(), 1, out.size(), stdout);
+        count_ += inputs.size();
+        for (size_t n : steps_)
+            total_steps_ += n;
+    }
+
+    size_t count() const { return count_; }
+    size_t steps() const { return total_steps_; }
+
+private:
+    void run_threads(std::vector<std::string_view> const& inputs) {
+        nn::thread_pool::instance().run(inputs.size(), [&](size_t i) {
+            auto start = clock_type::now();
+            nn::machine_result r = run_(std::string{inputs[i]}, o_.limit);
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count();
+            std::string& out = outputs_[i];
+            out = std::move(r.text);
+            if (o_.steps)
+                out += "\t" + std::to_string(r.steps);
+            if (o_.timings)
+                out += "\t" + std::to_string(us);
+            out.push_back(o_.delimiter);
+            steps_[i] = r.steps;
+        });
+    }
+
+    void run_processes(std::vector<std::string_view> const& inputs) {
+        std::vector<nn::process_result> results = processes_->run(inputs);
+        for (size_t i = 0; i != inputs.size(); ++i) {
+            nn::process_result& r = results[i];
+            std::string& out = outputs_[i];
+            switch (r.status) {
+            case nn::process_status::ok: out = std::move(r.text); break;
+            case nn::process_status::error: out = "!error: " + r.text; break;
+            case nn::process_status::timeout: out = "!timeout"; break;
+            case nn::process_status::overflow: out = "!overflow"; break;
+            default: out = "!crashed"; break;
+            }
+            if (o_.steps)
+                out += "\t" + std::to_string(r.steps);
+            out.push_back(o_.delimiter);
+            steps_[i] = r.steps;
+        }
+    }
+
+    options const& o_;
+    runner run_;
+    std::optional<nn::process_runner> processes_;
+    std::vector<std::string> outputs_;
+    std::vector<size_t> steps_;
+    size_t count_ = 0;
+    size_t total_steps_ = 0;
+};
+
+// splits the records of the buffer, the incomplete tail is left in it (unless at the end)
+void split(std::string_view& buffer, char delimiter, bool at_end, std::vector<std::string_view>& records) {
+    while (true) {
+        size_t end = buffer.find(delimiter);
+        if (end == buffer.npos)
+            break;
+        records.push_back(buffer.substr(0, end));
+        buffer.remove_prefix(end + 1);
+    }
+    if (at_end && !buffer.empty()) {
+        records.push_back(buffer);
+        buffer = {};
+    }
+}
+
+void run_mapped(options const& o, runner_loop& loop) {
+    nn::mapped_file f{o.input};
+    std::string_view rest = f.view();
+    std::vector<std::string_view> records;
+    while (!rest.empty()) {
+        records.clear();
+        while (!rest.empty() && records.size() != o.batch) {
+            size_t end = rest.find(o.delimiter);
+            records.push_back(rest.substr(0, end));
+            rest.remove_prefix(end == rest.npos ? rest.size() : end + 1);
+        }
+        loop.process(records);
+    }
+}
+
+void run_stdin(options const& o, runner_loop& loop) {
+    constexpr size_t block = size_t{1} << 20;
+    std::string buffer;
+    std::vector<std::string_view> records;
+    bool at_end = false;
+    while (!at_end) {
+        size_t had = buffer.size();
+        buffer.resize(had + block);
+        ssize_t n = ::read(STDIN_FILENO, buffer.data() + had, block);
+        if (n < 0) {
+            if (errno == EINTR) {
+                buffer.resize(had);
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "stdin");
+        }
+        buffer.resize(had + static_cast<size_t>(n));
+        at_end = n == 0;
+
+        std::string_view rest = buffer;
+        records.clear();
+        split(rest, o.delimiter, at_end, records);
+        for (size_t i = 0; i < records.size(); i += o.batch)
+            loop.process({records.begin() + i, records.begin() + std::min(records.size(), i + o.batch)});
+        buffer.erase(0, buffer.size() - rest.size());
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        options o = parse(argc, argv);
+
+        runner run;
+        if (!o.rules.empty()) {
+            auto program = std::make_shared<nn::runtime_program>(nn::runtime_program::load(o.rules));
+            run = [program](std::string text, size_t limit) { return program->run(std::move(text), limit); };
+        } else {
+            auto it = compiled.find(o.program);
+            if (it == compiled.end())
+                throw std::invalid_argument("unknown program " + o.program);
+            run = it->second;
+        }
+
+        runner_loop loop{o, std::move(run)};
+        auto start = clock_type::now();
+        if (o.input.empty())
+            run_stdin(o, loop);
+        else
+            run_mapped(o, loop);
+        std::fflush(stdout);
+
+        if (o.summary) {
+            double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+            std::cerr << "inputs=" << loop.count() << " steps=" << loop.steps()
+                      << " seconds=" << seconds
+                      << " inputs_per_second=" << static_cast<double>(loop.count()) / seconds
+                      << " steps_per_second=" << static_cast<double>(loop.steps()) / seconds << std::endl;
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
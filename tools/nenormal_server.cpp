@@ -0,0 +1,62 @@
+// nenormal-server: hosts the programs of programs.h over a unix domain socket
+//
+//   nenormal_server [socket path] [workers] [max batch] [batch window, us] [metrics file]
+//
+// with a metrics file, a snapshot of the machine metrics in the prometheus text format
+// is written there every second (e.g. for the textfile collector of node_exporter)
+
+#include "programs.h"
+#include "nenormal/service/server.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : "/tmp/nenormal.sock";
+    nn::service::server_options options;
+    if (argc > 2)
+        options.workers = std::strtoul(argv[2], nullptr, 10);
+    if (argc > 3)
+        options.max_batch = std::strtoul(argv[3], nullptr, 10);
+    if (argc > 4)
+        options.batch_window = std::chrono::microseconds{std::strtoul(argv[4], nullptr, 10)};
+    std::string metrics_path = argc > 5 ? argv[5] : "";
+    if (!metrics_path.empty())
+        nn::machine_metrics::instance().enable();
+
+    // signals are taken by sigwait, so block them before any thread starts
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    nn::service::program_registry registry;
+    tools::register_programs(registry);
+
+    try {
+        nn::service::unix_server server{path, registry, options};
+        std::cerr << "listening on " << path << ", programs:";
+        for (auto const& k : registry.keys())
+            std::cerr << " " << k;
+        std::cerr << std::endl;
+
+        int sig = 0;
+        if (metrics_path.empty()) {
+            sigwait(&signals, &sig);
+        } else {
+            timespec period{1, 0};
+            while (sigtimedwait(&signals, nullptr, &period) < 0)
+                nn::machine_metrics::instance().write(metrics_path, nn::metrics_format::prometheus);
+        }
+        server.stop();
+        if (!metrics_path.empty())
+            nn::machine_metrics::instance().write(metrics_path, nn::metrics_format::prometheus);
+        std::cerr << server.stats().str() << std::endl;
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "nenormal/nenormal.h"
+#include "nenormal/service/registry.h"
+
+// programs hosted by the tools
+
+namespace tools {
+
+constexpr auto brackets = NAMED_RULE(brackets, RULES(
+    RULE("()", ""),
+    RULE("[]", ""),
+    RULE("{}", ""),
+    RULE("(", "_"),
+    RULE("[", "_"),
+    RULE("{", "_"),
+    RULE(")", "_"),
+    RULE("]", "_"),
+    RULE("}", "_"),
+    RULE("__", "_"),
+    FINAL_RULE("_", "ERROR"),
+    FINAL_RULE("", "OK")
+));
+
+// binary increment: "1011+" -> "1100"
+constexpr auto increment = NAMED_RULE(increment, RULES(
+    RULE("0+", "1"),
+    RULE("1+", "+0"),
+    FINAL_RULE("+", "1") // carry out of the highest digit
+));
+
+inline void register_programs(nn::service::program_registry& registry) {
+    registry.add<brackets>("brackets");
+    registry.add<increment>("increment");
+}
+
+} // namespace tools